@@ -17,6 +17,8 @@
 #include "util.h"
 #include "libzerocoin/Denominations.h"
 
+#include <array>
+#include <stdexcept>
 #include <vector>
 
 
@@ -181,9 +183,11 @@ public:
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
 
-    //! zerocoin specific fields
-    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
-    std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
+    //! zerocoin specific fields, one entry per denomination in the order of zerocoinDenomList
+    //! supply of each denomination up to and including this block
+    std::array<int64_t, libzerocoin::ZEROCOIN_DENOM_COUNT> nZerocoinSupply;
+    //! number of mints of each denomination in this block, bounded well below 2^16 by the block size
+    std::array<uint16_t, libzerocoin::ZEROCOIN_DENOM_COUNT> nMintsInBlock;
 
     void SetNull()
     {
@@ -216,10 +220,8 @@ public:
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
         // Start supply of each denomination with 0s
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            mapZerocoinSupply.insert(std::make_pair(denom, 0));
-        }
-        vMintDenominationsInBlock.clear();
+        nZerocoinSupply.fill(0);
+        nMintsInBlock.fill(0);
     }
 
     CBlockIndex()
@@ -297,7 +299,12 @@ public:
      */
     int64_t GetZcMints(libzerocoin::CoinDenomination denom) const
     {
-        return mapZerocoinSupply.at(denom);
+        return nZerocoinSupply[GetZcIndex(denom)];
+    }
+
+    void AddZcMints(libzerocoin::CoinDenomination denom, int64_t nCount)
+    {
+        nZerocoinSupply[GetZcIndex(denom)] += nCount;
     }
 
     /**
@@ -312,7 +319,35 @@ public:
 
     bool MintedDenomination(libzerocoin::CoinDenomination denom) const
     {
-        return std::find(vMintDenominationsInBlock.begin(), vMintDenominationsInBlock.end(), denom) != vMintDenominationsInBlock.end();
+        return GetMintsInBlock(denom) > 0;
+    }
+
+    /** Number of mints of a denomination in this block. */
+    int GetMintsInBlock(libzerocoin::CoinDenomination denom) const
+    {
+        int i = libzerocoin::ZerocoinDenominationToIndex(denom);
+        return i < 0 ? 0 : nMintsInBlock[i];
+    }
+
+    void AddMintInBlock(libzerocoin::CoinDenomination denom)
+    {
+        int i = libzerocoin::ZerocoinDenominationToIndex(denom);
+        if (i >= 0)
+            nMintsInBlock[i]++;
+    }
+
+    void ClearMintsInBlock()
+    {
+        nMintsInBlock.fill(0);
+    }
+
+    //! Index of a denomination in the zerocoin fields, throws like the std::map they replace did
+    static unsigned int GetZcIndex(libzerocoin::CoinDenomination denom)
+    {
+        int i = libzerocoin::ZerocoinDenominationToIndex(denom);
+        if (i < 0)
+            throw std::out_of_range("invalid zerocoin denomination");
+        return i;
     }
 
     uint256 GetBlockHash() const
@@ -519,10 +554,55 @@ public:
         READWRITE(nNonce);
         if(this->nVersion > 3) {
             READWRITE(nAccumulatorCheckpoint);
-            READWRITE(mapZerocoinSupply);
-            READWRITE(vMintDenominationsInBlock);
+            SerializeZerocoinFields(s, ser_action, nType, nVersion);
+        }
+
+    }
+
+    /**
+     * The zerocoin fields are stored as the std::map<CoinDenomination, int64_t> of supply
+     * and the std::vector<CoinDenomination> of mints in the block that they used to be.
+     * Mints are written grouped by denomination, their order in the block is not kept.
+     */
+    template <typename Stream>
+    void SerializeZerocoinFields(Stream& s, CSerActionSerialize, int nType, int nSerVersion) const
+    {
+        WriteCompactSize(s, libzerocoin::ZEROCOIN_DENOM_COUNT);
+        for (unsigned int i = 0; i < libzerocoin::ZEROCOIN_DENOM_COUNT; i++) {
+            ::Serialize(s, libzerocoin::zerocoinDenomList[i], nType, nSerVersion);
+            ::Serialize(s, nZerocoinSupply[i], nType, nSerVersion);
         }
+        unsigned int nMints = 0;
+        for (unsigned int i = 0; i < libzerocoin::ZEROCOIN_DENOM_COUNT; i++)
+            nMints += nMintsInBlock[i];
+        WriteCompactSize(s, nMints);
+        for (unsigned int i = 0; i < libzerocoin::ZEROCOIN_DENOM_COUNT; i++) {
+            for (unsigned int j = 0; j < nMintsInBlock[i]; j++)
+                ::Serialize(s, libzerocoin::zerocoinDenomList[i], nType, nSerVersion);
+        }
+    }
 
+    template <typename Stream>
+    void SerializeZerocoinFields(Stream& s, CSerActionUnserialize, int nType, int nSerVersion)
+    {
+        nZerocoinSupply.fill(0);
+        unsigned int nSize = ReadCompactSize(s);
+        for (unsigned int n = 0; n < nSize; n++) {
+            libzerocoin::CoinDenomination denom;
+            int64_t nSupply;
+            ::Unserialize(s, denom, nType, nSerVersion);
+            ::Unserialize(s, nSupply, nType, nSerVersion);
+            int i = libzerocoin::ZerocoinDenominationToIndex(denom);
+            if (i >= 0)
+                nZerocoinSupply[i] = nSupply;
+        }
+        ClearMintsInBlock();
+        nSize = ReadCompactSize(s);
+        for (unsigned int n = 0; n < nSize; n++) {
+            libzerocoin::CoinDenomination denom;
+            ::Unserialize(s, denom, nType, nSerVersion);
+            AddMintInBlock(denom);
+        }
     }
 
     uint256 GetBlockHash() const
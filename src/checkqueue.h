@@ -160,6 +160,9 @@ public:
     {
     }
 
+    //! Mutex to ensure only one concurrent CCheckQueueControl
+    boost::mutex ControlMutex;
+
     bool IsIdle()
     {
         boost::unique_lock<boost::mutex> lock(mutex);
@@ -177,12 +180,15 @@ class CCheckQueueControl
 private:
     CCheckQueue<T>* pqueue;
     bool fDone;
+    boost::unique_lock<boost::mutex> controlLock;
 
 public:
     CCheckQueueControl(CCheckQueue<T>* pqueueIn) : pqueue(pqueueIn), fDone(false)
     {
         // passed queue is supposed to be unused, or NULL
         if (pqueue != NULL) {
+            // serialize masters that may call in from different threads
+            controlLock = boost::unique_lock<boost::mutex>(pqueue->ControlMutex);
             bool isIdle = pqueue->IsIdle();
             assert(isIdle);
         }
@@ -2,11 +2,40 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include "config/Zenon-config.h"
+#endif
+
 #include "crypto/sha256.h"
 
 #include "crypto/common.h"
 
+#include <algorithm>
+#include <chrono>
 #include <string.h>
+#include <string>
+#include <vector>
+
+#if defined(ENABLE_SHANI)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+#endif
+
+#if defined(ENABLE_SSE41)
+namespace sha256_sse41
+{
+void Transform_4way(uint32_t* s, const unsigned char* chunks);
+}
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace sha256_avx2
+{
+void Transform_8way(uint32_t* s, const unsigned char* chunks);
+}
+#endif
 
 // Internal implementation code.
 namespace
@@ -43,91 +72,230 @@ void inline Initialize(uint32_t* s)
     s[7] = 0x5be0cd19ul;
 }
 
-/** Perform one SHA-256 transformation, processing a 64-byte chunk. */
-void Transform(uint32_t* s, const unsigned char* chunk)
-{
-    uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
-    uint32_t w0, w1, w2, w3, w4, w5, w6, w7, w8, w9, w10, w11, w12, w13, w14, w15;
-
-    Round(a, b, c, d, e, f, g, h, 0x428a2f98, w0 = ReadBE32(chunk + 0));
-    Round(h, a, b, c, d, e, f, g, 0x71374491, w1 = ReadBE32(chunk + 4));
-    Round(g, h, a, b, c, d, e, f, 0xb5c0fbcf, w2 = ReadBE32(chunk + 8));
-    Round(f, g, h, a, b, c, d, e, 0xe9b5dba5, w3 = ReadBE32(chunk + 12));
-    Round(e, f, g, h, a, b, c, d, 0x3956c25b, w4 = ReadBE32(chunk + 16));
-    Round(d, e, f, g, h, a, b, c, 0x59f111f1, w5 = ReadBE32(chunk + 20));
-    Round(c, d, e, f, g, h, a, b, 0x923f82a4, w6 = ReadBE32(chunk + 24));
-    Round(b, c, d, e, f, g, h, a, 0xab1c5ed5, w7 = ReadBE32(chunk + 28));
-    Round(a, b, c, d, e, f, g, h, 0xd807aa98, w8 = ReadBE32(chunk + 32));
-    Round(h, a, b, c, d, e, f, g, 0x12835b01, w9 = ReadBE32(chunk + 36));
-    Round(g, h, a, b, c, d, e, f, 0x243185be, w10 = ReadBE32(chunk + 40));
-    Round(f, g, h, a, b, c, d, e, 0x550c7dc3, w11 = ReadBE32(chunk + 44));
-    Round(e, f, g, h, a, b, c, d, 0x72be5d74, w12 = ReadBE32(chunk + 48));
-    Round(d, e, f, g, h, a, b, c, 0x80deb1fe, w13 = ReadBE32(chunk + 52));
-    Round(c, d, e, f, g, h, a, b, 0x9bdc06a7, w14 = ReadBE32(chunk + 56));
-    Round(b, c, d, e, f, g, h, a, 0xc19bf174, w15 = ReadBE32(chunk + 60));
-
-    Round(a, b, c, d, e, f, g, h, 0xe49b69c1, w0 += sigma1(w14) + w9 + sigma0(w1));
-    Round(h, a, b, c, d, e, f, g, 0xefbe4786, w1 += sigma1(w15) + w10 + sigma0(w2));
-    Round(g, h, a, b, c, d, e, f, 0x0fc19dc6, w2 += sigma1(w0) + w11 + sigma0(w3));
-    Round(f, g, h, a, b, c, d, e, 0x240ca1cc, w3 += sigma1(w1) + w12 + sigma0(w4));
-    Round(e, f, g, h, a, b, c, d, 0x2de92c6f, w4 += sigma1(w2) + w13 + sigma0(w5));
-    Round(d, e, f, g, h, a, b, c, 0x4a7484aa, w5 += sigma1(w3) + w14 + sigma0(w6));
-    Round(c, d, e, f, g, h, a, b, 0x5cb0a9dc, w6 += sigma1(w4) + w15 + sigma0(w7));
-    Round(b, c, d, e, f, g, h, a, 0x76f988da, w7 += sigma1(w5) + w0 + sigma0(w8));
-    Round(a, b, c, d, e, f, g, h, 0x983e5152, w8 += sigma1(w6) + w1 + sigma0(w9));
-    Round(h, a, b, c, d, e, f, g, 0xa831c66d, w9 += sigma1(w7) + w2 + sigma0(w10));
-    Round(g, h, a, b, c, d, e, f, 0xb00327c8, w10 += sigma1(w8) + w3 + sigma0(w11));
-    Round(f, g, h, a, b, c, d, e, 0xbf597fc7, w11 += sigma1(w9) + w4 + sigma0(w12));
-    Round(e, f, g, h, a, b, c, d, 0xc6e00bf3, w12 += sigma1(w10) + w5 + sigma0(w13));
-    Round(d, e, f, g, h, a, b, c, 0xd5a79147, w13 += sigma1(w11) + w6 + sigma0(w14));
-    Round(c, d, e, f, g, h, a, b, 0x06ca6351, w14 += sigma1(w12) + w7 + sigma0(w15));
-    Round(b, c, d, e, f, g, h, a, 0x14292967, w15 += sigma1(w13) + w8 + sigma0(w0));
-
-    Round(a, b, c, d, e, f, g, h, 0x27b70a85, w0 += sigma1(w14) + w9 + sigma0(w1));
-    Round(h, a, b, c, d, e, f, g, 0x2e1b2138, w1 += sigma1(w15) + w10 + sigma0(w2));
-    Round(g, h, a, b, c, d, e, f, 0x4d2c6dfc, w2 += sigma1(w0) + w11 + sigma0(w3));
-    Round(f, g, h, a, b, c, d, e, 0x53380d13, w3 += sigma1(w1) + w12 + sigma0(w4));
-    Round(e, f, g, h, a, b, c, d, 0x650a7354, w4 += sigma1(w2) + w13 + sigma0(w5));
-    Round(d, e, f, g, h, a, b, c, 0x766a0abb, w5 += sigma1(w3) + w14 + sigma0(w6));
-    Round(c, d, e, f, g, h, a, b, 0x81c2c92e, w6 += sigma1(w4) + w15 + sigma0(w7));
-    Round(b, c, d, e, f, g, h, a, 0x92722c85, w7 += sigma1(w5) + w0 + sigma0(w8));
-    Round(a, b, c, d, e, f, g, h, 0xa2bfe8a1, w8 += sigma1(w6) + w1 + sigma0(w9));
-    Round(h, a, b, c, d, e, f, g, 0xa81a664b, w9 += sigma1(w7) + w2 + sigma0(w10));
-    Round(g, h, a, b, c, d, e, f, 0xc24b8b70, w10 += sigma1(w8) + w3 + sigma0(w11));
-    Round(f, g, h, a, b, c, d, e, 0xc76c51a3, w11 += sigma1(w9) + w4 + sigma0(w12));
-    Round(e, f, g, h, a, b, c, d, 0xd192e819, w12 += sigma1(w10) + w5 + sigma0(w13));
-    Round(d, e, f, g, h, a, b, c, 0xd6990624, w13 += sigma1(w11) + w6 + sigma0(w14));
-    Round(c, d, e, f, g, h, a, b, 0xf40e3585, w14 += sigma1(w12) + w7 + sigma0(w15));
-    Round(b, c, d, e, f, g, h, a, 0x106aa070, w15 += sigma1(w13) + w8 + sigma0(w0));
-
-    Round(a, b, c, d, e, f, g, h, 0x19a4c116, w0 += sigma1(w14) + w9 + sigma0(w1));
-    Round(h, a, b, c, d, e, f, g, 0x1e376c08, w1 += sigma1(w15) + w10 + sigma0(w2));
-    Round(g, h, a, b, c, d, e, f, 0x2748774c, w2 += sigma1(w0) + w11 + sigma0(w3));
-    Round(f, g, h, a, b, c, d, e, 0x34b0bcb5, w3 += sigma1(w1) + w12 + sigma0(w4));
-    Round(e, f, g, h, a, b, c, d, 0x391c0cb3, w4 += sigma1(w2) + w13 + sigma0(w5));
-    Round(d, e, f, g, h, a, b, c, 0x4ed8aa4a, w5 += sigma1(w3) + w14 + sigma0(w6));
-    Round(c, d, e, f, g, h, a, b, 0x5b9cca4f, w6 += sigma1(w4) + w15 + sigma0(w7));
-    Round(b, c, d, e, f, g, h, a, 0x682e6ff3, w7 += sigma1(w5) + w0 + sigma0(w8));
-    Round(a, b, c, d, e, f, g, h, 0x748f82ee, w8 += sigma1(w6) + w1 + sigma0(w9));
-    Round(h, a, b, c, d, e, f, g, 0x78a5636f, w9 += sigma1(w7) + w2 + sigma0(w10));
-    Round(g, h, a, b, c, d, e, f, 0x84c87814, w10 += sigma1(w8) + w3 + sigma0(w11));
-    Round(f, g, h, a, b, c, d, e, 0x8cc70208, w11 += sigma1(w9) + w4 + sigma0(w12));
-    Round(e, f, g, h, a, b, c, d, 0x90befffa, w12 += sigma1(w10) + w5 + sigma0(w13));
-    Round(d, e, f, g, h, a, b, c, 0xa4506ceb, w13 += sigma1(w11) + w6 + sigma0(w14));
-    Round(c, d, e, f, g, h, a, b, 0xbef9a3f7, w14 + sigma1(w12) + w7 + sigma0(w15));
-    Round(b, c, d, e, f, g, h, a, 0xc67178f2, w15 + sigma1(w13) + w8 + sigma0(w0));
-
-    s[0] += a;
-    s[1] += b;
-    s[2] += c;
-    s[3] += d;
-    s[4] += e;
-    s[5] += f;
-    s[6] += g;
-    s[7] += h;
+/** Perform a number of SHA-256 transformations, processing consecutive 64-byte chunks. */
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--) {
+        uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        uint32_t w0, w1, w2, w3, w4, w5, w6, w7, w8, w9, w10, w11, w12, w13, w14, w15;
+
+        Round(a, b, c, d, e, f, g, h, 0x428a2f98, w0 = ReadBE32(chunk + 0));
+        Round(h, a, b, c, d, e, f, g, 0x71374491, w1 = ReadBE32(chunk + 4));
+        Round(g, h, a, b, c, d, e, f, 0xb5c0fbcf, w2 = ReadBE32(chunk + 8));
+        Round(f, g, h, a, b, c, d, e, 0xe9b5dba5, w3 = ReadBE32(chunk + 12));
+        Round(e, f, g, h, a, b, c, d, 0x3956c25b, w4 = ReadBE32(chunk + 16));
+        Round(d, e, f, g, h, a, b, c, 0x59f111f1, w5 = ReadBE32(chunk + 20));
+        Round(c, d, e, f, g, h, a, b, 0x923f82a4, w6 = ReadBE32(chunk + 24));
+        Round(b, c, d, e, f, g, h, a, 0xab1c5ed5, w7 = ReadBE32(chunk + 28));
+        Round(a, b, c, d, e, f, g, h, 0xd807aa98, w8 = ReadBE32(chunk + 32));
+        Round(h, a, b, c, d, e, f, g, 0x12835b01, w9 = ReadBE32(chunk + 36));
+        Round(g, h, a, b, c, d, e, f, 0x243185be, w10 = ReadBE32(chunk + 40));
+        Round(f, g, h, a, b, c, d, e, 0x550c7dc3, w11 = ReadBE32(chunk + 44));
+        Round(e, f, g, h, a, b, c, d, 0x72be5d74, w12 = ReadBE32(chunk + 48));
+        Round(d, e, f, g, h, a, b, c, 0x80deb1fe, w13 = ReadBE32(chunk + 52));
+        Round(c, d, e, f, g, h, a, b, 0x9bdc06a7, w14 = ReadBE32(chunk + 56));
+        Round(b, c, d, e, f, g, h, a, 0xc19bf174, w15 = ReadBE32(chunk + 60));
+
+        Round(a, b, c, d, e, f, g, h, 0xe49b69c1, w0 += sigma1(w14) + w9 + sigma0(w1));
+        Round(h, a, b, c, d, e, f, g, 0xefbe4786, w1 += sigma1(w15) + w10 + sigma0(w2));
+        Round(g, h, a, b, c, d, e, f, 0x0fc19dc6, w2 += sigma1(w0) + w11 + sigma0(w3));
+        Round(f, g, h, a, b, c, d, e, 0x240ca1cc, w3 += sigma1(w1) + w12 + sigma0(w4));
+        Round(e, f, g, h, a, b, c, d, 0x2de92c6f, w4 += sigma1(w2) + w13 + sigma0(w5));
+        Round(d, e, f, g, h, a, b, c, 0x4a7484aa, w5 += sigma1(w3) + w14 + sigma0(w6));
+        Round(c, d, e, f, g, h, a, b, 0x5cb0a9dc, w6 += sigma1(w4) + w15 + sigma0(w7));
+        Round(b, c, d, e, f, g, h, a, 0x76f988da, w7 += sigma1(w5) + w0 + sigma0(w8));
+        Round(a, b, c, d, e, f, g, h, 0x983e5152, w8 += sigma1(w6) + w1 + sigma0(w9));
+        Round(h, a, b, c, d, e, f, g, 0xa831c66d, w9 += sigma1(w7) + w2 + sigma0(w10));
+        Round(g, h, a, b, c, d, e, f, 0xb00327c8, w10 += sigma1(w8) + w3 + sigma0(w11));
+        Round(f, g, h, a, b, c, d, e, 0xbf597fc7, w11 += sigma1(w9) + w4 + sigma0(w12));
+        Round(e, f, g, h, a, b, c, d, 0xc6e00bf3, w12 += sigma1(w10) + w5 + sigma0(w13));
+        Round(d, e, f, g, h, a, b, c, 0xd5a79147, w13 += sigma1(w11) + w6 + sigma0(w14));
+        Round(c, d, e, f, g, h, a, b, 0x06ca6351, w14 += sigma1(w12) + w7 + sigma0(w15));
+        Round(b, c, d, e, f, g, h, a, 0x14292967, w15 += sigma1(w13) + w8 + sigma0(w0));
+
+        Round(a, b, c, d, e, f, g, h, 0x27b70a85, w0 += sigma1(w14) + w9 + sigma0(w1));
+        Round(h, a, b, c, d, e, f, g, 0x2e1b2138, w1 += sigma1(w15) + w10 + sigma0(w2));
+        Round(g, h, a, b, c, d, e, f, 0x4d2c6dfc, w2 += sigma1(w0) + w11 + sigma0(w3));
+        Round(f, g, h, a, b, c, d, e, 0x53380d13, w3 += sigma1(w1) + w12 + sigma0(w4));
+        Round(e, f, g, h, a, b, c, d, 0x650a7354, w4 += sigma1(w2) + w13 + sigma0(w5));
+        Round(d, e, f, g, h, a, b, c, 0x766a0abb, w5 += sigma1(w3) + w14 + sigma0(w6));
+        Round(c, d, e, f, g, h, a, b, 0x81c2c92e, w6 += sigma1(w4) + w15 + sigma0(w7));
+        Round(b, c, d, e, f, g, h, a, 0x92722c85, w7 += sigma1(w5) + w0 + sigma0(w8));
+        Round(a, b, c, d, e, f, g, h, 0xa2bfe8a1, w8 += sigma1(w6) + w1 + sigma0(w9));
+        Round(h, a, b, c, d, e, f, g, 0xa81a664b, w9 += sigma1(w7) + w2 + sigma0(w10));
+        Round(g, h, a, b, c, d, e, f, 0xc24b8b70, w10 += sigma1(w8) + w3 + sigma0(w11));
+        Round(f, g, h, a, b, c, d, e, 0xc76c51a3, w11 += sigma1(w9) + w4 + sigma0(w12));
+        Round(e, f, g, h, a, b, c, d, 0xd192e819, w12 += sigma1(w10) + w5 + sigma0(w13));
+        Round(d, e, f, g, h, a, b, c, 0xd6990624, w13 += sigma1(w11) + w6 + sigma0(w14));
+        Round(c, d, e, f, g, h, a, b, 0xf40e3585, w14 += sigma1(w12) + w7 + sigma0(w15));
+        Round(b, c, d, e, f, g, h, a, 0x106aa070, w15 += sigma1(w13) + w8 + sigma0(w0));
+
+        Round(a, b, c, d, e, f, g, h, 0x19a4c116, w0 += sigma1(w14) + w9 + sigma0(w1));
+        Round(h, a, b, c, d, e, f, g, 0x1e376c08, w1 += sigma1(w15) + w10 + sigma0(w2));
+        Round(g, h, a, b, c, d, e, f, 0x2748774c, w2 += sigma1(w0) + w11 + sigma0(w3));
+        Round(f, g, h, a, b, c, d, e, 0x34b0bcb5, w3 += sigma1(w1) + w12 + sigma0(w4));
+        Round(e, f, g, h, a, b, c, d, 0x391c0cb3, w4 += sigma1(w2) + w13 + sigma0(w5));
+        Round(d, e, f, g, h, a, b, c, 0x4ed8aa4a, w5 += sigma1(w3) + w14 + sigma0(w6));
+        Round(c, d, e, f, g, h, a, b, 0x5b9cca4f, w6 += sigma1(w4) + w15 + sigma0(w7));
+        Round(b, c, d, e, f, g, h, a, 0x682e6ff3, w7 += sigma1(w5) + w0 + sigma0(w8));
+        Round(a, b, c, d, e, f, g, h, 0x748f82ee, w8 += sigma1(w6) + w1 + sigma0(w9));
+        Round(h, a, b, c, d, e, f, g, 0x78a5636f, w9 += sigma1(w7) + w2 + sigma0(w10));
+        Round(g, h, a, b, c, d, e, f, 0x84c87814, w10 += sigma1(w8) + w3 + sigma0(w11));
+        Round(f, g, h, a, b, c, d, e, 0x8cc70208, w11 += sigma1(w9) + w4 + sigma0(w12));
+        Round(e, f, g, h, a, b, c, d, 0x90befffa, w12 += sigma1(w10) + w5 + sigma0(w13));
+        Round(d, e, f, g, h, a, b, c, 0xa4506ceb, w13 += sigma1(w11) + w6 + sigma0(w14));
+        Round(c, d, e, f, g, h, a, b, 0xbef9a3f7, w14 + sigma1(w12) + w7 + sigma0(w15));
+        Round(b, c, d, e, f, g, h, a, 0xc67178f2, w15 + sigma1(w13) + w8 + sigma0(w0));
+
+        s[0] += a;
+        s[1] += b;
+        s[2] += c;
+        s[3] += d;
+        s[4] += e;
+        s[5] += f;
+        s[6] += g;
+        s[7] += h;
+        chunk += 64;
+    }
 }
 
 } // namespace sha256
+
+/** Transform function processing a number of consecutive chunks on one state. */
+typedef void (*TransformType)(uint32_t* s, const unsigned char* chunk, size_t blocks);
+
+/** Transform function running one chunk per lane on consecutive lane states. */
+typedef void (*TransformLanesType)(uint32_t* s, const unsigned char* chunks);
+
+/** Largest number of lanes a multi-lane transform may process at once. */
+static const size_t MAX_TRANSFORM_LANES = 8;
+
+struct TransformLanes {
+    TransformLanesType transform;
+    size_t nLanes;
+};
+
+/** The implementations in use, selected by SHA256AutoDetect(). */
+TransformType Transform = sha256::Transform;
+
+/** Perform one SHA-256 transformation on a single lane, with the selected implementation. */
+void Transform_1way(uint32_t* s, const unsigned char* chunks)
+{
+    Transform(s, chunks, 1);
+}
+
+TransformLanes Lanes = {Transform_1way, 1};
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+    __asm__("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(subleaf));
+}
+
+/** Check whether the OS saves the AVX (YMM) register state. */
+bool inline AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+/** Test data for the self-tests, four chunks that differ in every word. */
+void FillTestData(unsigned char* data, size_t nLen)
+{
+    for (size_t i = 0; i < nLen; i++)
+        data[i] = (unsigned char)(i * 0x9d + 0x37);
+}
+
+/** Check a transform gives the same states as the standard one, over one to four chunks. */
+bool SelfTest(TransformType transform)
+{
+    unsigned char data[64 * 4];
+    FillTestData(data, sizeof(data));
+    for (size_t blocks = 1; blocks <= 4; blocks++) {
+        uint32_t s[8], sRef[8];
+        sha256::Initialize(s);
+        sha256::Initialize(sRef);
+        transform(s, data, blocks);
+        sha256::Transform(sRef, data, blocks);
+        if (memcmp(s, sRef, sizeof(s)))
+            return false;
+    }
+    return true;
+}
+
+/** Check a multi-lane transform gives each lane the same state as the standard one. */
+bool SelfTest(const TransformLanes& lanes)
+{
+    unsigned char data[64 * MAX_TRANSFORM_LANES];
+    FillTestData(data, sizeof(data));
+    uint32_t s[8 * MAX_TRANSFORM_LANES];
+    for (size_t lane = 0; lane < lanes.nLanes; lane++)
+        sha256::Initialize(s + 8 * lane);
+    lanes.transform(s, data);
+    for (size_t lane = 0; lane < lanes.nLanes; lane++) {
+        uint32_t sRef[8];
+        sha256::Initialize(sRef);
+        sha256::Transform(sRef, data + 64 * lane, 1);
+        if (memcmp(s + 8 * lane, sRef, sizeof(sRef)))
+            return false;
+    }
+    return true;
+}
+
+/** The implementations this CPU supports, the standard one first. */
+void GetImplementations(std::vector<std::pair<std::string, TransformType> >& vTransforms, std::vector<std::pair<std::string, TransformLanes> >& vLanes)
+{
+    vTransforms.push_back(std::make_pair("standard", sha256::Transform));
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, 0, eax, ebx, ecx, edx);
+    const uint32_t nMaxLeaf = eax;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    const bool fSSE41 = (ecx >> 19) & 1;
+    const bool fAVX = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    bool fAVX2 = false;
+    bool fSHANI = false;
+    if (nMaxLeaf >= 7) {
+        cpuid(7, 0, eax, ebx, ecx, edx);
+        fAVX2 = fAVX && ((ebx >> 5) & 1);
+        fSHANI = fSSE41 && ((ebx >> 29) & 1);
+    }
+#if defined(ENABLE_SHANI)
+    if (fSHANI)
+        vTransforms.push_back(std::make_pair("shani(1way)", sha256_shani::Transform));
+#endif
+#if defined(ENABLE_SSE41)
+    if (fSSE41) {
+        TransformLanes lanes = {sha256_sse41::Transform_4way, 4};
+        vLanes.push_back(std::make_pair("sse41(4way)", lanes));
+    }
+#endif
+#if defined(ENABLE_AVX2)
+    if (fAVX2) {
+        TransformLanes lanes = {sha256_avx2::Transform_8way, 8};
+        vLanes.push_back(std::make_pair("avx2(8way)", lanes));
+    }
+#endif
+    (void)fSSE41;
+    (void)fAVX2;
+    (void)fSHANI;
+#endif
+}
+
+/** Fill chunk with the 64-byte block nBlock of the padded message msg of nLen bytes. */
+void inline FillChunk(unsigned char* chunk, const unsigned char* msg, size_t nLen, size_t nBlocks, size_t nBlock)
+{
+    const size_t nPos = nBlock * 64;
+    const size_t nCopy = nPos < nLen ? std::min<size_t>(64, nLen - nPos) : 0;
+    memcpy(chunk, msg + nPos, nCopy);
+    memset(chunk + nCopy, 0, 64 - nCopy);
+    if (nLen >= nPos && nLen < nPos + 64)
+        chunk[nLen - nPos] = 0x80;
+    if (nBlock + 1 == nBlocks)
+        WriteBE64(chunk + 56, (uint64_t)nLen << 3);
+}
 } // namespace
 
 
@@ -147,14 +315,15 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        Transform(s, buf, 1);
         bufsize = 0;
     }
-    while (end >= data + 64) {
+    if (end - data >= 64) {
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
-        bytes += 64;
-        data += 64;
+        size_t blocks = (end - data) / 64;
+        Transform(s, data, blocks);
+        data += 64 * blocks;
+        bytes += 64 * blocks;
     }
     if (end > data) {
         // Fill the buffer with what remains.
@@ -187,3 +356,105 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256DBatch(unsigned char* out, const unsigned char* in, size_t nLen, size_t nCount)
+{
+    const TransformLanes lanes = Lanes;
+    static const unsigned char pad32[32] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0};
+    const size_t nBlocks = (nLen + 9 + 63) / 64;
+    uint32_t s[8 * MAX_TRANSFORM_LANES];
+    unsigned char chunks[64 * MAX_TRANSFORM_LANES];
+
+    while (nCount > 0) {
+        // Run full groups through the multi-lane transform, and finish the tail one by one.
+        const size_t nLanes = nCount >= lanes.nLanes ? lanes.nLanes : 1;
+        const TransformLanesType transform = nLanes == lanes.nLanes ? lanes.transform : Transform_1way;
+
+        for (size_t lane = 0; lane < nLanes; lane++)
+            sha256::Initialize(s + 8 * lane);
+        for (size_t nBlock = 0; nBlock < nBlocks; nBlock++) {
+            for (size_t lane = 0; lane < nLanes; lane++)
+                FillChunk(chunks + 64 * lane, in + nLen * lane, nLen, nBlocks, nBlock);
+            transform(s, chunks);
+        }
+
+        // Second hash over the 32-byte first hash, which fits in one padded block.
+        for (size_t lane = 0; lane < nLanes; lane++) {
+            unsigned char* chunk = chunks + 64 * lane;
+            for (int i = 0; i < 8; i++)
+                WriteBE32(chunk + 4 * i, s[8 * lane + i]);
+            memcpy(chunk + 32, pad32, 32);
+            sha256::Initialize(s + 8 * lane);
+        }
+        transform(s, chunks);
+
+        for (size_t lane = 0; lane < nLanes; lane++) {
+            for (int i = 0; i < 8; i++)
+                WriteBE32(out + 32 * lane + 4 * i, s[8 * lane + i]);
+        }
+        in += nLen * nLanes;
+        out += 32 * nLanes;
+        nCount -= nLanes;
+    }
+}
+
+std::string SHA256AutoDetect()
+{
+    std::vector<std::pair<std::string, TransformType> > vTransforms;
+    std::vector<std::pair<std::string, TransformLanes> > vLanes;
+    GetImplementations(vTransforms, vLanes);
+
+    // Use the last (fastest) implementation of each kind that passes its self-test
+    std::string ret = "standard";
+    Transform = sha256::Transform;
+    for (const auto& it : vTransforms) {
+        if (it.second != sha256::Transform && SelfTest(it.second)) {
+            Transform = it.second;
+            ret = it.first;
+        }
+    }
+    TransformLanes lanes = {Transform_1way, 1};
+    std::string strLanes;
+    for (const auto& it : vLanes) {
+        if (SelfTest(it.second)) {
+            lanes = it.second;
+            strLanes = it.first;
+        }
+    }
+    // A hardware single lane beats running the generic code on SIMD lanes
+    if (Transform != sha256::Transform)
+        lanes = {Transform_1way, 1};
+    else if (!strLanes.empty())
+        ret += "," + strLanes;
+    Lanes = lanes;
+    return ret;
+}
+
+std::vector<std::pair<std::string, int64_t> > SHA256Benchmark(size_t nBytes)
+{
+    std::vector<std::pair<std::string, TransformType> > vTransforms;
+    std::vector<std::pair<std::string, TransformLanes> > vLanes;
+    GetImplementations(vTransforms, vLanes);
+
+    const size_t nChunks = std::max<size_t>(nBytes / (64 * MAX_TRANSFORM_LANES), 1) * MAX_TRANSFORM_LANES;
+    std::vector<unsigned char> data(64 * nChunks);
+    FillTestData(data.data(), data.size());
+    uint32_t s[8 * MAX_TRANSFORM_LANES];
+
+    std::vector<std::pair<std::string, int64_t> > ret;
+    for (const auto& it : vTransforms) {
+        sha256::Initialize(s);
+        const auto nStart = std::chrono::steady_clock::now();
+        it.second(s, data.data(), nChunks);
+        ret.push_back(std::make_pair(it.first, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - nStart).count()));
+    }
+    for (const auto& it : vLanes) {
+        for (size_t lane = 0; lane < it.second.nLanes; lane++)
+            sha256::Initialize(s + 8 * lane);
+        const auto nStart = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < nChunks; i += it.second.nLanes)
+            it.second.transform(s, data.data() + 64 * i);
+        ret.push_back(std::make_pair(it.first, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - nStart).count()));
+    }
+    return ret;
+}
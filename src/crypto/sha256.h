@@ -7,6 +7,9 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
+#include <utility>
+#include <vector>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +28,21 @@ public:
     CSHA256& Reset();
 };
 
+/** Autodetect the best available SHA-256 implementation, checking it against the
+ *  standard one first. Returns the name of the implementation in use.
+ */
+std::string SHA256AutoDetect();
+
+/** Time processing about nBytes with every SHA-256 implementation the CPU supports.
+ *  Returns the name of each implementation with the microseconds it took.
+ */
+std::vector<std::pair<std::string, int64_t> > SHA256Benchmark(size_t nBytes);
+
+/** Compute the double SHA-256 of nCount messages of nLen bytes each, stored one
+ *  after another at in, and write the nCount 32-byte hashes one after another
+ *  to out. Independent messages are hashed side by side on SIMD lanes when the
+ *  CPU supports it.
+ */
+void SHA256DBatch(unsigned char* out, const unsigned char* in, size_t nLen, size_t nCount);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -7,6 +7,8 @@
 #include <boost/assign/list_of.hpp>
 
 #include "chain.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "db.h"
 #include "kernel.h"
 #include "script/interpreter.h"
@@ -17,6 +19,10 @@
 #include "zznnchain.h"
 #include "chainparams.h"
 
+#include <atomic>
+
+#include <boost/thread.hpp>
+
 // v1 modifier interval.
 static const int64_t OLD_MODIFIER_INTERVAL = 2087;
 
@@ -274,6 +280,19 @@ bool GetKernelStakeModifier(const uint256& hashBlockFrom, uint64_t& nStakeModifi
     return true;
 }
 
+//Target of the kernel hash, weighted by the value of the stake input
+static uint256 GetStakeKernelTarget(const unsigned int nBits, const CAmount& nValueIn)
+{
+    // Base target
+    uint256 bnTarget;
+    bnTarget.SetCompact(nBits);
+
+    // Weighted target
+    uint256 bnWeight = uint256(nValueIn) / 100;
+    bnTarget *= bnWeight;
+    return bnTarget;
+}
+
 bool CheckStakeKernelHash(const CBlockIndex* pindexPrev, const unsigned int nBits, CStakeInput* stake, const unsigned int nTimeTx, uint256& hashProofOfStake, const bool fVerify)
 {
     // Calculate the proof of stake hash
@@ -283,14 +302,7 @@ bool CheckStakeKernelHash(const CBlockIndex* pindexPrev, const unsigned int nBit
 
     const CAmount& nValueIn = stake->GetValue();
     const CDataStream& ssUniqueID = stake->GetUniqueness();
-
-    // Base target
-    uint256 bnTarget;
-    bnTarget.SetCompact(nBits);
-
-    // Weighted target
-    uint256 bnWeight = uint256(nValueIn) / 100;
-    bnTarget *= bnWeight;
+    const uint256 bnTarget = GetStakeKernelTarget(nBits, nValueIn);
 
     // Check if proof-of-stake hash meets target protocol
     const bool res = (hashProofOfStake < bnTarget);
@@ -309,13 +321,14 @@ bool CheckStakeKernelHash(const CBlockIndex* pindexPrev, const unsigned int nBit
     return res;
 }
 
-bool GetHashProofOfStake(const CBlockIndex* pindexPrev, CStakeInput* stake, const unsigned int nTimeTx, const bool fVerify, uint256& hashProofOfStakeRet) {
+//Serialize the data hashed into the proof of stake hash to ss, and the modifier alone to modifier_ss
+static bool GetHashProofOfStakeData(const CBlockIndex* pindexPrev, CStakeInput* stake, const unsigned int nTimeTx, CDataStream& modifier_ss, CDataStream& ss)
+{
     // Grab the stake data
     CBlockIndex* pindexfrom = stake->GetIndexFrom();
     if (!pindexfrom) return error("%s : Failed to find the block index for stake origin", __func__);
     const CDataStream& ssUniqueID = stake->GetUniqueness();
     const unsigned int nTimeBlockFrom = pindexfrom->nTime;
-    CDataStream modifier_ss(SER_GETHASH, 0);
 
     // Hash the modifier
     if (!Params().IsStakeModifierV2(pindexPrev->nHeight + 1)) {
@@ -329,21 +342,113 @@ bool GetHashProofOfStake(const CBlockIndex* pindexPrev, CStakeInput* stake, cons
         modifier_ss << pindexPrev->nStakeModifierV2;
     }
 
-    CDataStream ss(modifier_ss);
-    // Calculate hash
+    ss = modifier_ss;
     ss << nTimeBlockFrom << ssUniqueID << nTimeTx;
+    return true;
+}
+
+bool GetHashProofOfStake(const CBlockIndex* pindexPrev, CStakeInput* stake, const unsigned int nTimeTx, const bool fVerify, uint256& hashProofOfStakeRet) {
+    CDataStream modifier_ss(SER_GETHASH, 0);
+    CDataStream ss(SER_GETHASH, 0);
+    if (!GetHashProofOfStakeData(pindexPrev, stake, nTimeTx, modifier_ss, ss))
+        return false;
+
+    // Calculate hash
     hashProofOfStakeRet = Hash(ss.begin(), ss.end());
 
     if (fVerify) {
         LogPrint("staking", "%s : nStakeModifier=%s (nStakeModifierHeight=%s)\n"
                 "nTimeBlockFrom=%d\nssUniqueIDD=%s\n-->DATA=%s\n",
             __func__, HexStr(modifier_ss), ((stake->IsZZNN()) ? "Not available" : std::to_string(stake->getStakeModifierHeight())),
-            nTimeBlockFrom, HexStr(ssUniqueID), HexStr(ss));
+            stake->GetIndexFrom()->nTime, HexStr(stake->GetUniqueness()), HexStr(ss));
     }
     return true;
 }
 
-bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int64_t& nTimeTx, uint256& hashProofOfStake)
+//Write the data hashed into the proof of stake hash to pch, the same bytes GetHashProofOfStakeData serializes.
+//Returns its length, or 0 if it could not be written or would not fit in STAKE_KERNEL_DATA_MAX_SIZE
+static size_t WriteHashProofOfStakeData(const CBlockIndex* pindexPrev, CStakeInput* stake, const unsigned int nTimeTx, unsigned char* pch)
+{
+    CBlockIndex* pindexfrom = stake->GetIndexFrom();
+    if (!pindexfrom) return 0;
+    const CDataStream ssUniqueID = stake->GetUniqueness();
+
+    size_t nLen = 0;
+    if (!Params().IsStakeModifierV2(pindexPrev->nHeight + 1)) {
+        uint64_t nStakeModifier = 0;
+        if (!stake->GetModifier(nStakeModifier))
+            return 0;
+        WriteLE64(pch, nStakeModifier);
+        nLen += 8;
+    } else {
+        memcpy(pch, pindexPrev->nStakeModifierV2.begin(), 32);
+        nLen += 32;
+    }
+    if (nLen + 4 + ssUniqueID.size() + 4 > STAKE_KERNEL_DATA_MAX_SIZE)
+        return 0;
+
+    WriteLE32(pch + nLen, pindexfrom->nTime);
+    nLen += 4;
+    if (!ssUniqueID.empty())
+        memcpy(pch + nLen, &ssUniqueID[0], ssUniqueID.size());
+    nLen += ssUniqueID.size();
+    WriteLE32(pch + nLen, nTimeTx);
+    return nLen + 4;
+}
+
+bool GetHashProofOfStakeBatch(const CBlockIndex* pindexPrev, const std::vector<CStakeInput*>& vStakes, const unsigned int nTimeTx, CStakeKernelBatchBuffer& buffer, std::vector<uint256>& vHashProofOfStakeRet)
+{
+    assert(vStakes.size() <= STAKE_KERNEL_BATCH_SIZE);
+    vHashProofOfStakeRet.assign(vStakes.size(), 0);
+
+    // The data of all inputs is written side by side into the buffer and hashed together. Its
+    // length only differs between the kinds of stake input, the inputs of another length than
+    // the first one are left for another round.
+    std::vector<size_t> vIndex;
+    std::vector<size_t> vLeft(vStakes.size());
+    for (size_t i = 0; i < vStakes.size(); i++)
+        vLeft[i] = i;
+    std::vector<uint256> vHashes;
+    while (!vLeft.empty()) {
+        size_t nLen = 0;
+        vIndex.clear();
+        size_t nLeft = 0;
+        for (size_t i : vLeft) {
+            const size_t nLenData = WriteHashProofOfStakeData(pindexPrev, vStakes[i], nTimeTx, buffer.data + nLen * vIndex.size());
+            if (nLenData == 0)
+                return false;
+            if (nLen == 0)
+                nLen = nLenData;
+            if (nLenData == nLen)
+                vIndex.push_back(i);
+            else
+                vLeft[nLeft++] = i;
+        }
+        vLeft.resize(nLeft);
+
+        vHashes.resize(vIndex.size());
+        SHA256DBatch(vHashes[0].begin(), buffer.data, nLen, vIndex.size());
+        for (size_t j = 0; j < vIndex.size(); j++)
+            vHashProofOfStakeRet[vIndex[j]] = vHashes[j];
+    }
+    return true;
+}
+
+//Check the stake input is deep enough to stake on top of pindexPrev under time protocol V2
+static bool CheckStakeKernelDepth(const CBlockIndex* pindexPrev, CStakeInput* stakeInput)
+{
+    const int nHeight = pindexPrev->nHeight + 1;
+    CBlockIndex* pindexFrom = stakeInput->GetIndexFrom();
+    if (!pindexFrom || pindexFrom->nHeight < 1) return error("%s : no pindexfrom", __func__);
+
+    const int nHeightBlockFrom = pindexFrom->nHeight;
+    if (nHeight < nHeightBlockFrom + Params().COINSTAKE_MIN_DEPTH())
+        return error("%s : min depth violation, nHeight=%d, nHeightBlockFrom=%d", __func__, nHeight, nHeightBlockFrom);
+    return true;
+}
+
+//Look for a kernel of one stake input, fHashed tells whether any hashing was done
+static bool FindStakeKernel(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int64_t& nTimeTx, uint256& hashProofOfStake, bool& fHashed)
 {
     const int nHeight = pindexPrev->nHeight + 1;
 
@@ -354,9 +459,8 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
     // Time protocol V2: one-try
     if (Params().IsTimeProtocolV2(nHeight)) {
         // check required min depth for stake
-        const int nHeightBlockFrom = pindexFrom->nHeight;
-        if (nHeight < nHeightBlockFrom + Params().COINSTAKE_MIN_DEPTH())
-            return error("%s : min depth violation, nHeight=%d, nHeightBlockFrom=%d", __func__, nHeight, nHeightBlockFrom);
+        if (!CheckStakeKernelDepth(pindexPrev, stakeInput))
+            return false;
 
         nTimeTx = GetCurrentTimeSlot();
         // double check that we are not on the same slot as prev block
@@ -364,11 +468,8 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
             return false;
 
         // check stake kernel
-        bool ans = CheckStakeKernelHash(pindexPrev, nBits, stakeInput, nTimeTx, hashProofOfStake);
-        
-        mapHashedBlocks.clear();
-        mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
-        return ans;
+        fHashed = true;
+        return CheckStakeKernelHash(pindexPrev, nBits, stakeInput, nTimeTx, hashProofOfStake);
     }
     int prevHeight = pindexPrev->nHeight;
 
@@ -380,6 +481,7 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
                      __func__, prevHeight + 1, nTimeTx, nTimeBlockFrom, nHeightBlockFrom);
 
     // iterate the hashing
+    fHashed = true;
     bool fSuccess = false;
     const unsigned int nHashDrift = 60;
     unsigned int nTryTime = nTimeTx - 1;
@@ -402,11 +504,131 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
         nTimeTx = nTryTime;
         break;
     }
-    mapHashedBlocks.clear();
-    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
     return fSuccess;
 }
 
+bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int64_t& nTimeTx, uint256& hashProofOfStake)
+{
+    bool fHashed = false;
+    bool fSuccess = FindStakeKernel(pindexPrev, stakeInput, nBits, nTimeTx, hashProofOfStake, fHashed);
+    if (fHashed) {
+        mapHashedBlocks.clear();
+        mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    }
+    return fSuccess;
+}
+
+int StakeParallel(const CBlockIndex* pindexPrev, const std::vector<CStakeInput*>& vInputs, size_t nStart, unsigned int nBits, int64_t& nTimeTx, uint256& hashProofOfStake, int nThreads)
+{
+    // Time protocol V2 tries a single time slot shared by all inputs, so their kernels are hashed in batches
+    const bool fBatch = Params().IsTimeProtocolV2(pindexPrev->nHeight + 1);
+    const int64_t nTimeSlot = fBatch ? GetCurrentTimeSlot() : nTimeTx;
+    // double check that we are not on the same slot as prev block
+    if (fBatch && nTimeSlot <= pindexPrev->nTime && Params().NetworkID() != CBaseChainParams::REGTEST)
+        return -1;
+
+    // Inputs are handed out in order, so once a kernel is found every input before it has been tried
+    std::atomic<size_t> nNext(nStart);
+    std::atomic<bool> fStop(false);
+    std::atomic<bool> fAnyHashed(false);
+
+    CCriticalSection cs_found;
+    size_t nFound = vInputs.size();
+    int64_t nTimeFound = nTimeTx;
+    uint256 hashFound = 0;
+
+    auto found = [&](size_t i, int64_t nTime, const uint256& hash) {
+        LOCK(cs_found);
+        if (i < nFound) {
+            nFound = i;
+            nTimeFound = nTime;
+            hashFound = hash;
+        }
+        fStop = true;
+    };
+
+    auto search = [&]() {
+        while (!fStop) {
+            size_t i = nNext++;
+            if (i >= vInputs.size())
+                break;
+
+            int64_t nTime = nTimeTx;
+            uint256 hash = 0;
+            bool fHashed = false;
+            bool fKernel = FindStakeKernel(pindexPrev, vInputs[i], nBits, nTime, hash, fHashed);
+            if (fHashed)
+                fAnyHashed = true;
+            if (fKernel)
+                found(i, nTime, hash);
+        }
+    };
+
+    auto searchBatch = [&]() {
+        std::vector<CStakeInput*> vBatch;
+        std::vector<size_t> vIndex;
+        std::vector<uint256> vHashes;
+        CStakeKernelBatchBuffer buffer;
+        while (!fStop) {
+            const size_t nBegin = nNext.fetch_add(STAKE_KERNEL_BATCH_SIZE);
+            if (nBegin >= vInputs.size())
+                break;
+            const size_t nEnd = std::min(nBegin + STAKE_KERNEL_BATCH_SIZE, vInputs.size());
+
+            vBatch.clear();
+            vIndex.clear();
+            for (size_t i = nBegin; i < nEnd; i++) {
+                if (!CheckStakeKernelDepth(pindexPrev, vInputs[i]))
+                    continue;
+                vBatch.push_back(vInputs[i]);
+                vIndex.push_back(i);
+            }
+            if (vBatch.empty())
+                continue;
+            fAnyHashed = true;
+
+            // only a hash under its target is checked again in full, if the batch
+            // could not be hashed every input is checked on its own
+            const bool fBatched = GetHashProofOfStakeBatch(pindexPrev, vBatch, nTimeSlot, buffer, vHashes);
+            for (size_t j = 0; j < vBatch.size(); j++) {
+                if (fBatched && !(vHashes[j] < GetStakeKernelTarget(nBits, vBatch[j]->GetValue())))
+                    continue;
+                uint256 hash = 0;
+                if (!CheckStakeKernelHash(pindexPrev, nBits, vBatch[j], nTimeSlot, hash))
+                    continue;
+                found(vIndex[j], nTimeSlot, hash);
+                break;
+            }
+        }
+    };
+
+    //the calling thread searches as well
+    boost::thread_group threadGroup;
+    for (int i = 1; i < nThreads; i++) {
+        if (fBatch)
+            threadGroup.create_thread(searchBatch);
+        else
+            threadGroup.create_thread(search);
+    }
+    if (fBatch)
+        searchBatch();
+    else
+        search();
+    threadGroup.join_all();
+
+    if (fAnyHashed) {
+        mapHashedBlocks.clear();
+        mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    }
+
+    if (nFound == vInputs.size())
+        return -1;
+
+    nTimeTx = nTimeFound;
+    hashProofOfStake = hashFound;
+    return (int)nFound;
+}
+
 bool ContextualCheckZerocoinStake(int nPreviousBlockHeight, CStakeInput* stake)
 {
     if (nPreviousBlockHeight < Params().Zerocoin_Block_V2_Start())
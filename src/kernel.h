@@ -23,6 +23,10 @@ bool GetKernelStakeModifier(const uint256& hashBlockFrom, uint64_t& nStakeModifi
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 uint256 ComputeStakeModifier(const CBlockIndex* pindexPrev, const uint256& kernel);
 bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int64_t& nTimeTx, uint256& hashProofOfStake);
+// Look for a kernel among vInputs[nStart..] on nThreads threads, stopping at the first one found.
+// Under time protocol V2 the kernels of the inputs are hashed in batches.
+// Returns the index of the kernel input, all inputs before it have been tried, or -1 if there is none.
+int StakeParallel(const CBlockIndex* pindexPrev, const std::vector<CStakeInput*>& vInputs, size_t nStart, unsigned int nBits, int64_t& nTimeTx, uint256& hashProofOfStake, int nThreads);
 
 // Initialize the stake input object
 bool initStakeInput(const CBlock block, std::unique_ptr<CStakeInput>& stake, int nPreviousBlockHeight);
@@ -33,6 +37,16 @@ bool CheckProofOfStake(const CBlock& block, uint256& hashProofOfStake, std::uniq
 bool CheckStakeKernelHash(const CBlockIndex* pindexPrev, const unsigned int nBits, CStakeInput* stake, const unsigned int nTimeTx, uint256& hashProofOfStake, const bool fVerify = false);
 // Returns the proof of stake hash
 bool GetHashProofOfStake(const CBlockIndex* pindexPrev, CStakeInput* stake, const unsigned int nTimeTx, const bool fVerify, uint256& hashProofOfStakeRet);
+// Number of stake inputs a time protocol V2 search hashes side by side at once.
+static const size_t STAKE_KERNEL_BATCH_SIZE = 64;
+// Longest data hashed into a proof of stake hash: a v2 modifier, the time of the block from, an outpoint and the time
+static const size_t STAKE_KERNEL_DATA_MAX_SIZE = 32 + 4 + 36 + 4;
+// Room for the data of a batch, from a 64-byte boundary for the hashing lanes; kept from one batch to the next
+struct CStakeKernelBatchBuffer {
+    alignas(64) unsigned char data[STAKE_KERNEL_BATCH_SIZE * STAKE_KERNEL_DATA_MAX_SIZE];
+};
+// Returns the proof of stake hashes of up to STAKE_KERNEL_BATCH_SIZE stake inputs at the same time, hashed side by side
+bool GetHashProofOfStakeBatch(const CBlockIndex* pindexPrev, const std::vector<CStakeInput*>& vStakes, const unsigned int nTimeTx, CStakeKernelBatchBuffer& buffer, std::vector<uint256>& vHashProofOfStakeRet);
 // Get stake modifier checksum
 unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex);
 
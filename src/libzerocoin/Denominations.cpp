@@ -49,6 +49,21 @@ int64_t ZerocoinDenominationToInt(const CoinDenomination& denomination)
     return Value;
 }
 
+int ZerocoinDenominationToIndex(const CoinDenomination& denomination)
+{
+    switch (denomination) {
+    case CoinDenomination::ZQ_ONE: return 0;
+    case CoinDenomination::ZQ_FIVE: return 1;
+    case CoinDenomination::ZQ_TEN: return 2;
+    case CoinDenomination::ZQ_FIFTY: return 3;
+    case CoinDenomination::ZQ_ONE_HUNDRED: return 4;
+    case CoinDenomination::ZQ_FIVE_HUNDRED: return 5;
+    case CoinDenomination::ZQ_ONE_THOUSAND: return 6;
+    case CoinDenomination::ZQ_FIVE_THOUSAND: return 7;
+    default: return -1;
+    }
+}
+
 CoinDenomination AmountToZerocoinDenomination(CAmount amount)
 {
     // Check to make sure amount is an exact integer number of COINS
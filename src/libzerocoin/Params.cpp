@@ -26,6 +26,11 @@ ZerocoinParams::ZerocoinParams(CBigNum N, uint32_t securityLevel) {
 	// Generate the parameters
 	CalculateParams(*this, N, ZEROCOIN_PROTOCOL_VERSION, securityLevel);
 
+	// Precompute the powers of the fixed generators used by the proofs
+	this->coinCommitmentGroup.PrecomputeFixedBases();
+	this->serialNumberSoKCommitmentGroup.PrecomputeFixedBases();
+	this->accumulatorParams.accumulatorPoKCommitmentGroup.PrecomputeFixedBases();
+
 	this->accumulatorParams.initialized = true;
 	this->initialized = true;
 }
@@ -38,6 +43,79 @@ IntegerGroupParams::IntegerGroupParams() {
 	this->initialized = false;
 }
 
+void IntegerGroupParams::PrecomputeFixedBases() {
+	this->gTable.Init(this->g, this->modulus, this->groupOrder);
+	this->hTable.Init(this->h, this->modulus, this->groupOrder);
+}
+
+CBigNum IntegerGroupParams::pow_g(const CBigNum& e) const {
+	if (!this->gTable.IsInitialized())
+		return this->g.pow_mod(e, this->modulus);
+	return this->gTable.pow_mod(e);
+}
+
+CBigNum IntegerGroupParams::pow_h(const CBigNum& e) const {
+	if (!this->hTable.IsInitialized())
+		return this->h.pow_mod(e, this->modulus);
+	return this->hTable.pow_mod(e);
+}
+
+FixedBasePowTable::FixedBasePowTable(): maxBits(0) {}
+
+void FixedBasePowTable::Init(const CBigNum& base, const CBigNum& modulus, const CBigNum& order) {
+	this->base = base;
+	this->modulus = modulus;
+	this->table.clear();
+
+	// Exponents can only be reduced mod "order" if it really is a multiple
+	// of the order of the base.
+	if (order > CBigNum(0) && base.pow_mod(order, modulus).isOne()) {
+		this->order = order;
+		this->maxBits = order.bitSize();
+	} else {
+		this->order = CBigNum(0);
+		this->maxBits = modulus.bitSize();
+	}
+
+	// One row per nibble, rounded up to whole bytes
+	uint32_t nRows = 2 * ((this->maxBits + 7) / 8);
+	this->table.reserve(nRows * WINDOW_SIZE);
+	CBigNum rowBase = base % modulus;
+	for (uint32_t i = 0; i < nRows; i++) {
+		this->table.push_back(rowBase);
+		for (uint32_t j = 1; j < WINDOW_SIZE; j++)
+			this->table.push_back(this->table.back().mul_mod(rowBase, modulus));
+		// base^(16^(i+1)) = base^(15 * 16^i) * base^(16^i)
+		rowBase = this->table.back().mul_mod(rowBase, modulus);
+	}
+}
+
+CBigNum FixedBasePowTable::pow_mod(const CBigNum& e) const {
+	CBigNum exp = e;
+	if ((exp < CBigNum(0) || (uint32_t)exp.bitSize() > this->maxBits) && this->order > CBigNum(0))
+		exp = exp % this->order;
+
+	// g^-x = (g^x)^-1
+	if (exp < CBigNum(0))
+		return this->pow_mod(CBigNum(0) - exp).inverse(this->modulus);
+
+	if ((uint32_t)exp.bitSize() > this->maxBits)
+		return this->base.pow_mod(exp, this->modulus);
+
+	// getvch() is little endian, possibly with a trailing (zero) sign byte
+	std::vector<unsigned char> vch = exp.getvch();
+	CBigNum ret = CBigNum(1);
+	for (uint32_t i = 0; i < vch.size(); i++) {
+		unsigned int nLow = vch[i] & 0x0f;
+		unsigned int nHigh = vch[i] >> 4;
+		if (nLow)
+			ret = ret.mul_mod(this->table[(2 * i) * WINDOW_SIZE + nLow - 1], this->modulus);
+		if (nHigh)
+			ret = ret.mul_mod(this->table[(2 * i + 1) * WINDOW_SIZE + nHigh - 1], this->modulus);
+	}
+	return ret % this->modulus;
+}
+
 CBigNum IntegerGroupParams::randomElement() const {
 	// The generator of the group raised
 	// to a random number less than the order of the group
@@ -19,6 +19,45 @@
 
 namespace libzerocoin {
 
+/**
+ * Precomputed powers of a fixed base for windowed fixed-base exponentiation.
+ * Row i of the table holds base^(j * 16^i) mod modulus for j = 1..15, so
+ * base^e costs one modular multiplication per non-zero nibble of e and no
+ * squarings. Table lookups depend on the exponent: only use it where the
+ * exponent is public or timing leaks are acceptable (see ZEROCOIN_FAST_MINT).
+ */
+class FixedBasePowTable {
+public:
+	FixedBasePowTable();
+
+	/**
+	 * Builds the table.
+	 * @param base     the fixed base
+	 * @param modulus  the modulus
+	 * @param order    the order of base, used to reduce exponents that are
+	 *                 negative or wider than the table. Ignored unless
+	 *                 base^order = 1 mod modulus.
+	 */
+	void Init(const CBigNum& base, const CBigNum& modulus, const CBigNum& order);
+
+	bool IsInitialized() const { return !table.empty(); }
+
+	/**
+	 * Modular exponentiation: base^e mod modulus.
+	 * Always returns the same value as base.pow_mod(e, modulus).
+	 */
+	CBigNum pow_mod(const CBigNum& e) const;
+
+private:
+	static const unsigned int WINDOW_SIZE = 15;
+
+	CBigNum base;
+	CBigNum modulus;
+	CBigNum order;
+	uint32_t maxBits;
+	std::vector<CBigNum> table;
+};
+
 class IntegerGroupParams {
 public:
 	/** @brief Integer group class, default constructor
@@ -56,6 +95,19 @@ public:
 	 */
 	CBigNum groupOrder;
 
+	/**
+	 * Precomputes the fixed-base tables for g and h.
+	 * Must be called once the group is fully set up.
+	 */
+	void PrecomputeFixedBases();
+
+	/**
+	 * g^e mod modulus and h^e mod modulus, using the fixed-base tables
+	 * when they have been precomputed.
+	 */
+	CBigNum pow_g(const CBigNum& e) const;
+	CBigNum pow_h(const CBigNum& e) const;
+
 	ADD_SERIALIZE_METHODS;
   template <typename Stream, typename Operation>  inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
 		    READWRITE(initialized);
@@ -64,6 +116,10 @@ public:
 		    READWRITE(modulus);
 		    READWRITE(groupOrder);
 	}	
+
+private:
+	FixedBasePowTable gTable;
+	FixedBasePowTable hTable;
 };
 
 class AccumulatorAndProofParams {
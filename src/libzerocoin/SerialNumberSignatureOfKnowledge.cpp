@@ -16,6 +16,9 @@
 
 namespace libzerocoin {
 
+// Building a table for the commitment costs about as much as eight exponentiations
+static const uint32_t MIN_ROUNDS_FOR_COMMITMENT_TABLE = 8;
+
 SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const ZerocoinParams* p): params(p) { }
 
 // Use one 256 bit seed and concatenate 4 unique 256 bit hashes to make a 1024 bit hash
@@ -109,7 +112,16 @@ SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const
 }
 
 inline CBigNum SerialNumberSignatureOfKnowledge::challengeCalculation(const CBigNum& a_exp,const CBigNum& b_exp,
-        const CBigNum& h_exp) const {
+        const CBigNum& h_exp, bool fPublicExponents) const {
+
+    // a and b live in the group whose modulus is the order of the SoK group
+    if (fPublicExponents && params->coinCommitmentGroup.modulus == params->serialNumberSoKCommitmentGroup.groupOrder) {
+        CBigNum exponent = (params->coinCommitmentGroup.pow_g(a_exp) * params->coinCommitmentGroup.pow_h(b_exp)) %
+                params->serialNumberSoKCommitmentGroup.groupOrder;
+
+        return (params->serialNumberSoKCommitmentGroup.pow_g(exponent) * params->serialNumberSoKCommitmentGroup.pow_h(h_exp)) %
+                params->serialNumberSoKCommitmentGroup.modulus;
+    }
 
     CBigNum a = params->coinCommitmentGroup.g;
     CBigNum b = params->coinCommitmentGroup.h;
@@ -147,6 +159,18 @@ bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, c
     std::vector<CBigNum> tprime(params->zkp_iterations);
     unsigned char *hashbytes = (unsigned char*) &this->hash;
 
+    // All exponents are public here, so the fixed-base tables can be used
+    bool fFixedBase = (params->coinCommitmentGroup.modulus == params->serialNumberSoKCommitmentGroup.groupOrder);
+
+    // The commitment to the coin is the base of every round with a zero
+    // challenge bit, so share a fixed-base table for it between those rounds.
+    uint32_t nZeroBits = 0;
+    for (uint32_t i = 0; i < params->zkp_iterations; i++)
+        nZeroBits += !((hashbytes[i / 8] >> (i % 8)) & 0x01);
+    FixedBasePowTable commitmentTable;
+    if (nZeroBits >= MIN_ROUNDS_FOR_COMMITMENT_TABLE)
+        commitmentTable.Init(valueOfCommitmentToCoin, params->serialNumberSoKCommitmentGroup.modulus, CBigNum(0));
+
     try {
         for (uint32_t i = 0; i < params->zkp_iterations; i++) {
             int bit = i % 8;
@@ -156,12 +180,15 @@ bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, c
                 CBigNum bn = SeedTo1024(sprime[i].getuint256());
                 if (bn > params->serialNumberSoKCommitmentGroup.groupOrder && isInParamsValidationRange)
                     return error("SoK Verify() :: sprime in pos %d not in valid range", i);
-                tprime[i] = challengeCalculation(coinSerialNumber, s_notprime[i], bn);
+                tprime[i] = challengeCalculation(coinSerialNumber, s_notprime[i], bn, true);
             } else {
-                CBigNum exp = b.pow_mod(s_notprime[i], params->serialNumberSoKCommitmentGroup.groupOrder);
-                tprime[i] = ((valueOfCommitmentToCoin.pow_mod(exp, params->serialNumberSoKCommitmentGroup.modulus) %
+                CBigNum exp = fFixedBase ? params->coinCommitmentGroup.pow_h(s_notprime[i]) :
+                              b.pow_mod(s_notprime[i], params->serialNumberSoKCommitmentGroup.groupOrder);
+                CBigNum bnCommitmentPow = commitmentTable.IsInitialized() ? commitmentTable.pow_mod(exp) :
+                                          valueOfCommitmentToCoin.pow_mod(exp, params->serialNumberSoKCommitmentGroup.modulus);
+                tprime[i] = ((bnCommitmentPow %
                               params->serialNumberSoKCommitmentGroup.modulus) *
-                             (h.pow_mod(sprime[i], params->serialNumberSoKCommitmentGroup.modulus) %
+                             (params->serialNumberSoKCommitmentGroup.pow_h(sprime[i]) %
                               params->serialNumberSoKCommitmentGroup.modulus)) %
                             params->serialNumberSoKCommitmentGroup.modulus;
             }
@@ -67,8 +67,11 @@ private:
     // define something named s and it conflicts
     std::vector<CBigNum> s_notprime;
     std::vector<CBigNum> sprime;
+    /** Computes g^{a^a_exp b^b_exp} h^h_exp. The fixed-base tables of the params are only
+     *  used when fPublicExponents is set, so proving keeps constant-time exponentiation.
+     */
     inline CBigNum challengeCalculation(const CBigNum& a_exp, const CBigNum& b_exp,
-                                       const CBigNum& h_exp) const;
+                                       const CBigNum& h_exp, bool fPublicExponents = false) const;
 };
 
 } /* namespace libzerocoin */
@@ -146,6 +146,17 @@ public:
      */
     CBigNum pow_mod(const CBigNum& e, const CBigNum& m) const;
 
+    /**
+     * simultaneous modular exponentiation: (bases[0]^exps[0] * ... * bases[n-1]^exps[n-1]) mod m
+     * The squarings are shared between all the bases (Straus' method), so this is
+     * much cheaper than separate pow_mod calls. It is not constant time: only use
+     * it with public exponents.
+     * @param bases the bases
+     * @param exps the exponents, one per base
+     * @param m modulus
+     */
+    static CBigNum multi_pow_mod(const std::vector<CBigNum>& bases, const std::vector<CBigNum>& exps, const CBigNum& m);
+
     /**
     * Calculates the inverse of this element mod m.
     * i.e. i such this*i = 1 mod m
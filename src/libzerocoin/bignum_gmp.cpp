@@ -6,6 +6,8 @@
 
 #include "bignum.h"
 
+#include <algorithm>
+
 /** C++ wrapper for BIGNUM (Gmp bignum) */
 CBigNum::CBigNum()
 {
@@ -245,6 +247,161 @@ CBigNum CBigNum::pow_mod(const CBigNum& e, const CBigNum& m) const
     return ret;
 }
 
+namespace {
+
+//! Size, in bits, of the exponent windows used by multi_pow_mod
+const unsigned int MULTI_POW_WINDOW = 4;
+
+/** Montgomery multiplication modulo an odd modulus of n limbs, on top of the mpn layer */
+class CMontgomeryCtx
+{
+private:
+    mpz_srcptr pmod;
+    mp_size_t n;
+    std::vector<mp_limb_t> vMod;
+    //! -m^-1 mod 2^GMP_NUMB_BITS
+    mp_limb_t nInv;
+    std::vector<mp_limb_t> vTmp;
+
+    //! r = vTmp * R^-1 mod m, for vTmp < m * R
+    void Redc(mp_limb_t* r)
+    {
+        mp_limb_t nCarry = 0;
+        for (mp_size_t i = 0; i < n; i++) {
+            mp_limb_t q = vTmp[i] * nInv;
+            mp_limb_t cy = mpn_addmul_1(&vTmp[i], vMod.data(), n, q);
+            nCarry += mpn_add_1(&vTmp[i + n], &vTmp[i + n], n - i, cy);
+        }
+        if (nCarry || mpn_cmp(&vTmp[n], vMod.data(), n) >= 0)
+            mpn_sub_n(r, &vTmp[n], vMod.data(), n);
+        else
+            std::copy(vTmp.begin() + n, vTmp.end(), r);
+    }
+
+public:
+    explicit CMontgomeryCtx(mpz_srcptr m) : pmod(m), n(mpz_size(m)), vMod(n), vTmp(2 * n)
+    {
+        for (mp_size_t i = 0; i < n; i++)
+            vMod[i] = mpz_getlimbn(m, i);
+        // Newton iteration, each step doubles the number of correct low bits of m^-1
+        mp_limb_t inv = vMod[0];
+        for (int i = 0; i < 6; i++)
+            inv *= 2 - vMod[0] * inv;
+        nInv = 0 - inv;
+    }
+
+    mp_size_t size() const { return n; }
+
+    //! r = x * R mod m, with R = 2^(n * GMP_NUMB_BITS) and x >= 0
+    void ToMont(mp_limb_t* r, mpz_srcptr x) const
+    {
+        mpz_t t;
+        mpz_init(t);
+        mpz_mul_2exp(t, x, n * GMP_NUMB_BITS);
+        mpz_mod(t, t, pmod);
+        for (mp_size_t i = 0; i < n; i++)
+            r[i] = mpz_getlimbn(t, i);
+        mpz_clear(t);
+    }
+
+    //! r = x * R^-1 mod m
+    void FromMont(mpz_ptr r, const mp_limb_t* x)
+    {
+        std::vector<mp_limb_t> vRet(n);
+        std::fill(vTmp.begin() + n, vTmp.end(), 0);
+        std::copy(x, x + n, vTmp.begin());
+        Redc(vRet.data());
+        mpz_import(r, n, -1, sizeof(mp_limb_t), 0, 0, vRet.data());
+    }
+
+    //! r = a * b * R^-1 mod m, r may alias a or b
+    void Mul(mp_limb_t* r, const mp_limb_t* a, const mp_limb_t* b)
+    {
+        if (a == b)
+            mpn_sqr(vTmp.data(), a, n);
+        else
+            mpn_mul_n(vTmp.data(), a, b, n);
+        Redc(r);
+    }
+};
+
+}
+
+/**
+ * simultaneous modular exponentiation: (bases[0]^exps[0] * ... * bases[n-1]^exps[n-1]) mod m
+ * @param bases the bases
+ * @param exps the exponents, one per base
+ * @param m modulus
+ */
+CBigNum CBigNum::multi_pow_mod(const std::vector<CBigNum>& bases, const std::vector<CBigNum>& exps, const CBigNum& m)
+{
+    if (bases.size() != exps.size())
+        throw bignum_error("CBigNum::multi_pow_mod : number of bases and exponents differ");
+
+    // Montgomery reduction needs an odd modulus; fall back to separate
+    // exponentiations for anything else, including non invertible bases.
+    bool fFallback = !mpz_odd_p(m.bn) || mpz_cmp_ui(m.bn, 1) <= 0;
+
+    std::vector<CBigNum> vBases(bases.size());
+    std::vector<CBigNum> vExps(exps.size());
+    for (unsigned int i = 0; i < bases.size() && !fFallback; i++) {
+        mpz_mod(vBases[i].bn, bases[i].bn, m.bn);
+        mpz_abs(vExps[i].bn, exps[i].bn);
+        // g^-x = (g^-1)^x
+        if (mpz_sgn(exps[i].bn) < 0 && !mpz_invert(vBases[i].bn, vBases[i].bn, m.bn))
+            fFallback = true;
+    }
+
+    CBigNum ret = 1;
+    if (fFallback) {
+        for (unsigned int i = 0; i < bases.size(); i++)
+            ret = ret.mul_mod(bases[i].pow_mod(exps[i], m), m);
+        return ret % m;
+    }
+
+    // Table of base^1 .. base^(2^w - 1) for every base, in Montgomery form
+    CMontgomeryCtx ctx(m.bn);
+    const mp_size_t n = ctx.size();
+    const unsigned int nTableSize = (1 << MULTI_POW_WINDOW) - 1;
+    std::vector<mp_limb_t> vTable(bases.size() * nTableSize * n);
+    size_t nMaxBits = 0;
+    for (unsigned int i = 0; i < bases.size(); i++) {
+        mp_limb_t* pRow = &vTable[i * nTableSize * n];
+        ctx.ToMont(pRow, vBases[i].bn);
+        for (unsigned int j = 1; j < nTableSize; j++)
+            ctx.Mul(pRow + j * n, pRow + (j - 1) * n, pRow);
+        nMaxBits = std::max(nMaxBits, mpz_sizeinbase(vExps[i].bn, 2));
+    }
+
+    // Left to right over the windows of all the exponents at once
+    std::vector<mp_limb_t> vAcc(n);
+    bool fOne = true;
+    for (size_t nWindow = (nMaxBits + MULTI_POW_WINDOW - 1) / MULTI_POW_WINDOW; nWindow-- > 0;) {
+        if (!fOne) {
+            for (unsigned int k = 0; k < MULTI_POW_WINDOW; k++)
+                ctx.Mul(vAcc.data(), vAcc.data(), vAcc.data());
+        }
+        for (unsigned int i = 0; i < bases.size(); i++) {
+            unsigned int nDigit = 0;
+            for (unsigned int k = MULTI_POW_WINDOW; k-- > 0;)
+                nDigit = (nDigit << 1) | mpz_tstbit(vExps[i].bn, nWindow * MULTI_POW_WINDOW + k);
+            if (nDigit == 0)
+                continue;
+            const mp_limb_t* pEntry = &vTable[(i * nTableSize + nDigit - 1) * n];
+            if (fOne)
+                std::copy(pEntry, pEntry + n, vAcc.begin());
+            else
+                ctx.Mul(vAcc.data(), vAcc.data(), pEntry);
+            fOne = false;
+        }
+    }
+
+    if (fOne)
+        return ret % m;
+    ctx.FromMont(ret.bn, vAcc.data());
+    return ret;
+}
+
 /**
 * Calculates the inverse of this element mod m.
 * i.e. i such this*i = 1 mod m
@@ -6,6 +6,8 @@
 
 #include "bignum.h"
 
+#include <algorithm>
+
 CBigNum::CBigNum()
 {
     bn = BN_new();
@@ -373,6 +375,121 @@ CBigNum CBigNum::pow_mod(const CBigNum& e, const CBigNum& m) const
     return ret;
 }
 
+namespace {
+
+//! Size, in bits, of the exponent windows used by multi_pow_mod
+const unsigned int MULTI_POW_WINDOW = 4;
+
+class CAutoBN_MONT_CTX
+{
+protected:
+    BN_MONT_CTX* pmont;
+
+public:
+    CAutoBN_MONT_CTX()
+    {
+        pmont = BN_MONT_CTX_new();
+        if (pmont == NULL)
+            throw bignum_error("CAutoBN_MONT_CTX : BN_MONT_CTX_new() returned NULL");
+    }
+
+    ~CAutoBN_MONT_CTX()
+    {
+        if (pmont != NULL)
+            BN_MONT_CTX_free(pmont);
+    }
+
+    operator BN_MONT_CTX*() { return pmont; }
+};
+
+}
+
+/**
+ * simultaneous modular exponentiation: (bases[0]^exps[0] * ... * bases[n-1]^exps[n-1]) mod m
+ * @param bases the bases
+ * @param exps the exponents, one per base
+ * @param m modulus
+ */
+CBigNum CBigNum::multi_pow_mod(const std::vector<CBigNum>& bases, const std::vector<CBigNum>& exps, const CBigNum& m)
+{
+    if (bases.size() != exps.size())
+        throw bignum_error("CBigNum::multi_pow_mod : number of bases and exponents differ");
+
+    CAutoBN_CTX pctx;
+
+    // Montgomery reduction needs an odd modulus; fall back to separate
+    // exponentiations for anything else, including non invertible bases.
+    bool fFallback = !BN_is_odd(m.bn) || BN_is_one(m.bn) || BN_is_negative(m.bn);
+
+    std::vector<CBigNum> vBases(bases.size());
+    std::vector<CBigNum> vExps(exps.size());
+    for (unsigned int i = 0; i < bases.size() && !fFallback; i++) {
+        if (!BN_nnmod(vBases[i].bn, bases[i].bn, m.bn, pctx))
+            throw bignum_error("CBigNum::multi_pow_mod : BN_nnmod failed");
+        vExps[i] = exps[i];
+        if (exps[i] < 0) {
+            // g^-x = (g^-1)^x
+            BN_set_negative(vExps[i].bn, 0);
+            if (!BN_mod_inverse(vBases[i].bn, vBases[i].bn, m.bn, pctx))
+                fFallback = true;
+        }
+    }
+
+    CBigNum ret = 1;
+    if (fFallback) {
+        for (unsigned int i = 0; i < bases.size(); i++)
+            ret = ret.mul_mod(bases[i].pow_mod(exps[i], m), m);
+        return ret % m;
+    }
+
+    // Table of base^1 .. base^(2^w - 1) for every base, in Montgomery form
+    CAutoBN_MONT_CTX mont;
+    if (!BN_MONT_CTX_set(mont, m.bn, pctx))
+        throw bignum_error("CBigNum::multi_pow_mod : BN_MONT_CTX_set failed");
+    const unsigned int nTableSize = (1 << MULTI_POW_WINDOW) - 1;
+    std::vector<CBigNum> vTable(bases.size() * nTableSize);
+    int nMaxBits = 0;
+    for (unsigned int i = 0; i < bases.size(); i++) {
+        CBigNum* pRow = &vTable[i * nTableSize];
+        if (!BN_to_montgomery(pRow[0].bn, vBases[i].bn, mont, pctx))
+            throw bignum_error("CBigNum::multi_pow_mod : BN_to_montgomery failed");
+        for (unsigned int j = 1; j < nTableSize; j++)
+            if (!BN_mod_mul_montgomery(pRow[j].bn, pRow[j - 1].bn, pRow[0].bn, mont, pctx))
+                throw bignum_error("CBigNum::multi_pow_mod : BN_mod_mul_montgomery failed");
+        nMaxBits = std::max(nMaxBits, BN_num_bits(vExps[i].bn));
+    }
+
+    // Left to right over the windows of all the exponents at once
+    CBigNum acc;
+    bool fOne = true;
+    for (int nWindow = (nMaxBits + MULTI_POW_WINDOW - 1) / MULTI_POW_WINDOW; nWindow-- > 0;) {
+        if (!fOne) {
+            for (unsigned int k = 0; k < MULTI_POW_WINDOW; k++)
+                if (!BN_mod_mul_montgomery(acc.bn, acc.bn, acc.bn, mont, pctx))
+                    throw bignum_error("CBigNum::multi_pow_mod : BN_mod_mul_montgomery failed");
+        }
+        for (unsigned int i = 0; i < bases.size(); i++) {
+            unsigned int nDigit = 0;
+            for (unsigned int k = MULTI_POW_WINDOW; k-- > 0;)
+                nDigit = (nDigit << 1) | (BN_is_bit_set(vExps[i].bn, nWindow * MULTI_POW_WINDOW + k) ? 1 : 0);
+            if (nDigit == 0)
+                continue;
+            const CBigNum& entry = vTable[i * nTableSize + nDigit - 1];
+            if (fOne)
+                acc = entry;
+            else if (!BN_mod_mul_montgomery(acc.bn, acc.bn, entry.bn, mont, pctx))
+                throw bignum_error("CBigNum::multi_pow_mod : BN_mod_mul_montgomery failed");
+            fOne = false;
+        }
+    }
+
+    if (fOne)
+        return ret % m;
+    if (!BN_from_montgomery(ret.bn, acc.bn, mont, pctx))
+        throw bignum_error("CBigNum::multi_pow_mod : BN_from_montgomery failed");
+    return ret;
+}
+
 /**
 * Calculates the inverse of this element mod m.
 * i.e. i such this*i = 1 mod m
@@ -47,6 +47,7 @@
 #include <boost/thread.hpp>
 #include <boost/foreach.hpp>
 #include <atomic>
+#include <memory>
 #include <queue>
 
 #if defined(NDEBUG)
@@ -187,6 +188,30 @@ std::set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 std::set<int> setDirtyFileInfo;
+
+/**
+ * Block index entries are allocated in chunks rather than one by one, which saves the
+ * allocator overhead per entry and keeps them close together. They are only freed all at once.
+ */
+const size_t BLOCK_INDEX_CHUNK_SIZE = 4096;
+std::vector<std::unique_ptr<CBlockIndex[]> > vBlockIndexChunks;
+size_t nBlockIndexChunkUsed = BLOCK_INDEX_CHUNK_SIZE;
+
+/** Returns a new entry in the state of a default constructed CBlockIndex. */
+CBlockIndex* NewBlockIndex()
+{
+    if (nBlockIndexChunkUsed == BLOCK_INDEX_CHUNK_SIZE) {
+        vBlockIndexChunks.emplace_back(new CBlockIndex[BLOCK_INDEX_CHUNK_SIZE]);
+        nBlockIndexChunkUsed = 0;
+    }
+    return &vBlockIndexChunks.back()[nBlockIndexChunkUsed++];
+}
+
+void FreeBlockIndexes()
+{
+    vBlockIndexChunks.clear();
+    nBlockIndexChunkUsed = BLOCK_INDEX_CHUNK_SIZE;
+}
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -612,10 +637,27 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache* pcoinsTip = NULL;
+static std::unique_ptr<CCoinsViewCache> pcoinsTipCache;
 CBlockTreeDB* pblocktree = NULL;
 CZerocoinDB* zerocoinDB = NULL;
 CSporkDB* pSporkDB = NULL;
 
+CCoinsViewCache* GetTipCoinsCache()
+{
+    AssertLockHeld(cs_main);
+    if (pcoinsTipCache && pcoinsTipCache->GetCacheSize() + pcoinsTip->GetCacheSize() > nCoinCacheSize)
+        pcoinsTipCache.reset();
+    if (!pcoinsTipCache)
+        pcoinsTipCache.reset(new CCoinsViewCache(pcoinsTip));
+    return pcoinsTipCache.get();
+}
+
+void ResetTipCoinsCache()
+{
+    AssertLockHeld(cs_main);
+    pcoinsTipCache.reset();
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
@@ -1070,7 +1112,7 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const lib
 }
 
 
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack)
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack, bool cacheStore, std::vector<CZerocoinSpendCheck>* pvChecks)
 {
     //max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
     if (tx.vout.size() > 2) {
@@ -1145,12 +1187,15 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
                     return state.DoS(100, error("%s: Zerocoinspend could not find accumulator associated with checksum %s", __func__, HexStr(BEGIN(nChecksum), END(nChecksum))));
                 }
 
-                libzerocoin::Accumulator accumulator(Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start()),
-                                        newSpend.getDenomination(), bnAccumulatorValue);
+                libzerocoin::ZerocoinParams* paramsAccumulator = Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start());
 
                 //Check that the coin has been accumulated
-                if(!newSpend.Verify(accumulator, !fFakeSerialAttack))
-                        return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+                CZerocoinSpendCheck check(newSpend, paramsAccumulator, bnAccumulatorValue, !fFakeSerialAttack, tx.GetHash(), cacheStore);
+                if (pvChecks) {
+                    pvChecks->push_back(CZerocoinSpendCheck());
+                    check.swap(pvChecks->back());
+                } else if (!check())
+                    return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
             }
 
         if (serials.count(newSpend.getCoinSerialNumber()))
@@ -1170,7 +1215,7 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
     return fValidated;
 }
 
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack)
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack, bool cacheStore, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -1240,7 +1285,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fReject
 
             // Do not require signature verification if this is initial sync and a block over 24 hours old
             bool fVerifySignature = !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*24));
-            if (!CheckZerocoinSpend(tx, fVerifySignature, state, fFakeSerialAttack))
+            if (!CheckZerocoinSpend(tx, fVerifySignature, state, fFakeSerialAttack, cacheStore, pvZerocoinChecks))
                 return state.DoS(100, error("CheckTransaction() : invalid zerocoin spend"));
         }
     }
@@ -1330,8 +1375,18 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
     return nMinFee;
 }
 
+/** Drop expired transactions, then evict the cheapest packages until the pool fits -maxmempool */
+static void LimitMempoolSize(CTxMemPool& pool)
+{
+    int nExpired = pool.Expire(GetTime() - GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    if (nExpired != 0)
+        LogPrint("mempool", "Expired %i transactions from the memory pool\n", nExpired);
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
+    pool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+}
+
+
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees, bool fOverrideMempoolLimit)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -1342,7 +1397,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         return state.DoS(10, error("AcceptToMemoryPool : Zerocoin transactions are temporarily disabled for maintenance"), REJECT_INVALID, "bad-tx");
 
     int chainHeight = chainActive.Height();
-    if (!CheckTransaction(tx, chainHeight >= Params().Zerocoin_StartHeight(), true, state, isBlockBetweenFakeSerialAttackRange(chainHeight)))
+    if (!CheckTransaction(tx, chainHeight >= Params().Zerocoin_StartHeight(), true, state, isBlockBetweenFakeSerialAttackRange(chainHeight), true))
         return state.DoS(100, error("AcceptToMemoryPool: : CheckTransaction failed"), REJECT_INVALID, "bad-tx");
 
     // Coinbase is only valid in a block, not as a loose transaction
@@ -1523,7 +1578,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         CAmount nFees = nValueIn - nValueOut;
         double dPriority = 0;
         if (!tx.HasZerocoinSpendInputs())
-            view.GetPriority(tx, chainActive.Height());
+            dPriority = view.GetPriority(tx, chainActive.Height());
 
         CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
         unsigned int nSize = entry.GetTxSize();
@@ -1539,6 +1594,16 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                                         hash.ToString(), nFees, txMinFee),
                     REJECT_INSUFFICIENTFEE, "insufficient fee");
 
+            // The pool raises its minimum fee while it is full
+            double dPriorityDelta = 0;
+            CAmount nFeeDelta = 0;
+            pool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
+            CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+            if (mempoolRejectFee > 0 && nFees + nFeeDelta < mempoolRejectFee && !tx.HasZerocoinSpendInputs())
+                return state.DoS(0, error("AcceptToMemoryPool : mempool min fee not met %s, %d < %d",
+                                        hash.ToString(), nFees + nFeeDelta, mempoolRejectFee),
+                    REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+
             // Require that free transactions have sufficient priority to be mined in the next block.
             if (tx.HasZerocoinMintOutputs()) {
                 if(nFees < Params().Zerocoin_MintFee() * tx.GetZerocoinMintCount())
@@ -1587,6 +1652,18 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                          nFees, ::minRelayTxFee.GetFee(nSize) * 10000);
         }
 
+        // Calculate in-mempool ancestors, up to a limit.
+        CTxMemPool::setEntries setAncestors;
+        size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+        size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+        size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+        size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+        std::string errString;
+        if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+            return state.DoS(0, error("AcceptToMemoryPool : %s %s", hash.ToString(), errString),
+                REJECT_NONSTANDARD, "too-long-mempool-chain");
+        }
+
         bool fCLTVHasMajority = CBlockIndex::IsSuperMajority(5, chainActive.Tip(), Params().EnforceBlockUpgradeMajority());
 
         // Check against previous transactions
@@ -1615,7 +1692,14 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         }
 
         // Store transaction in memory
-        pool.addUnchecked(hash, entry);
+        pool.addUnchecked(hash, entry, setAncestors);
+
+        // Make room for it, it may well be the cheapest package itself
+        if (!fOverrideMempoolLimit) {
+            LimitMempoolSize(pool);
+            if (!pool.exists(hash))
+                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+        }
     }
 
     SyncWithWallets(tx, NULL);
@@ -1634,7 +1718,7 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
         *pfMissingInputs = false;
 
 
-    if (!CheckTransaction(tx, chainActive.Height() >= Params().Zerocoin_StartHeight(), true, state))
+    if (!CheckTransaction(tx, chainActive.Height() >= Params().Zerocoin_StartHeight(), true, state, false, true))
         return error("AcceptableInputs: : CheckTransaction failed");
 
     // Coinbase is only valid in a block, not as a loose transaction
@@ -2134,23 +2218,50 @@ void CheckForkWarningConditionsOnNewFork(CBlockIndex* pindexNewForkTip)
     CheckForkWarningConditions();
 }
 
+// Penalties waiting for cs_main, see Misbehaving
+static std::vector<std::pair<NodeId, int> > vPendingMisbehavior;
+static CCriticalSection cs_vPendingMisbehavior;
+
 // Requires cs_main.
+static void ApplyPendingMisbehavior()
+{
+    std::vector<std::pair<NodeId, int> > vMisbehavior;
+    {
+        LOCK(cs_vPendingMisbehavior);
+        vMisbehavior.swap(vPendingMisbehavior);
+    }
+
+    for (const std::pair<NodeId, int>& misbehavior : vMisbehavior) {
+        int howmuch = misbehavior.second;
+        CNodeState* state = State(misbehavior.first);
+        if (state == NULL)
+            continue;
+
+        state->nMisbehavior += howmuch;
+        int banscore = GetArg("-banscore", 100);
+        if (state->nMisbehavior >= banscore && state->nMisbehavior - howmuch < banscore) {
+            LogPrintf("Misbehaving: %s (%d -> %d) BAN THRESHOLD EXCEEDED\n", state->name, state->nMisbehavior - howmuch, state->nMisbehavior);
+            state->fShouldBan = true;
+        } else
+            LogPrintf("Misbehaving: %s (%d -> %d)\n", state->name, state->nMisbehavior - howmuch, state->nMisbehavior);
+    }
+}
+
+// Applied right away when cs_main is free or held by the caller, otherwise by the next
+// SendMessages. The concurrent message handlers call this without cs_main.
 void Misbehaving(NodeId pnode, int howmuch)
 {
     if (howmuch == 0)
         return;
 
-    CNodeState* state = State(pnode);
-    if (state == NULL)
-        return;
+    {
+        LOCK(cs_vPendingMisbehavior);
+        vPendingMisbehavior.push_back(std::make_pair(pnode, howmuch));
+    }
 
-    state->nMisbehavior += howmuch;
-    int banscore = GetArg("-banscore", 100);
-    if (state->nMisbehavior >= banscore && state->nMisbehavior - howmuch < banscore) {
-        LogPrintf("Misbehaving: %s (%d -> %d) BAN THRESHOLD EXCEEDED\n", state->name, state->nMisbehavior - howmuch, state->nMisbehavior);
-        state->fShouldBan = true;
-    } else
-        LogPrintf("Misbehaving: %s (%d -> %d)\n", state->name, state->nMisbehavior - howmuch, state->nMisbehavior);
+    TRY_LOCK(cs_main, lockMain);
+    if (lockMain)
+        ApplyPendingMisbehavior();
 }
 
 void static InvalidChainFound(CBlockIndex* pindexNew)
@@ -2213,6 +2324,66 @@ bool CScriptCheck::operator()()
     return true;
 }
 
+namespace {
+
+/**
+ * Valid zerocoin spend cache, to avoid verifying the proofs of a spend
+ * twice (once when accepted into memory pool, and again when accepted
+ * into the block chain)
+ */
+class CZerocoinSpendCache
+{
+private:
+    //! hashes of (spend, accumulator value, accumulator modulus, serial check)
+    std::set<uint256> setValid;
+    boost::shared_mutex cs_zcspendcache;
+
+public:
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_zcspendcache);
+        return setValid.count(entry) != 0;
+    }
+
+    void Set(const uint256& entry)
+    {
+        int64_t nMaxCacheSize = GetArg("-maxzcspendcachesize", DEFAULT_MAX_ZCSPEND_CACHE_SIZE);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_zcspendcache);
+
+        while (static_cast<int64_t>(setValid.size()) >= nMaxCacheSize) {
+            // Evict a random entry, see CSignatureCache
+            std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+        setValid.insert(entry);
+    }
+};
+
+CZerocoinSpendCache zerocoinSpendCache;
+
+}
+
+bool CZerocoinSpendCheck::operator()()
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << spend << bnAccumulatorValue << params->accumulatorParams.accumulatorModulus << fVerifySerial;
+    uint256 entry = ss.GetHash();
+    if (zerocoinSpendCache.Get(entry))
+        return true;
+
+    libzerocoin::Accumulator accumulator(params, spend.getDenomination(), bnAccumulatorValue);
+    if (!spend.Verify(accumulator, fVerifySerial))
+        return ::error("CZerocoinSpendCheck(): zerocoin spend with serial %s in tx %s did not verify", spend.getCoinSerialNumber().GetHex(), txid.GetHex());
+
+    if (cacheStore)
+        zerocoinSpendCache.Set(entry);
+    return true;
+}
+
 CBitcoinAddress addressExp1("DQZzqnSR6PXxagep1byLiRg9ZurCZ5KieQ");
 CBitcoinAddress addressExp2("DTQYdnNqKuEHXyNeeYhPQGGGdqHbXYwjpj");
 
@@ -2544,6 +2715,11 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             if(!EraseAccumulatorValues(nCheckpoint, pindex->pprev->nAccumulatorCheckpoint))
                 return error("DisconnectBlock(): failed to erase checkpoint");
         }
+        EraseChecksumHeights(pindex);
+        zerocoinDB->EraseBlockMints(pindex->nHeight);
+
+        if (!mnodeman.DisconnectPillarBlock(block, pindex))
+            return error("DisconnectBlock(): failed to update pillar utxo index");
     }
 
     if (pfClean) {
@@ -2587,6 +2763,15 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+// Spend proofs are expensive, so hand them out to the workers one at a time
+static CCheckQueue<CZerocoinSpendCheck> zerocoinspendcheckqueue(1);
+
+void ThreadZerocoinSpendCheck()
+{
+    RenameThread("Zenon-zcspendch");
+    zerocoinspendcheckqueue.Thread();
+}
+
 void AddWrappedSerialsInflation()
 {
     CBlockIndex* pindex = chainActive[Params().Zerocoin_Block_EndFakeSerial()];
@@ -2603,7 +2788,7 @@ void AddWrappedSerialsInflation()
 
         // Add inflated denominations to block index mapSupply
         for (auto denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
+            pindex->AddZcMints(denom, GetWrapppedSerialInflation(denom));
         }
         // Update current block index to disk
         assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
@@ -2635,10 +2820,9 @@ void RecalculateZZNNMinted()
         std::list<CZerocoinMint> listMints;
         BlockToZerocoinMintList(block, listMints, true);
 
-        std::vector<libzerocoin::CoinDenomination> vDenomsBefore = pindex->vMintDenominationsInBlock;
-        pindex->vMintDenominationsInBlock.clear();
+        pindex->ClearMintsInBlock();
         for (auto mint : listMints)
-            pindex->vMintDenominationsInBlock.emplace_back(mint.GetDenomination());
+            pindex->AddMintInBlock(mint.GetDenomination());
 
         if (pindex->nHeight < chainActive.Height())
             pindex = chainActive.Next(pindex);
@@ -2666,22 +2850,21 @@ void RecalculateZZNNSpent()
         std::list<libzerocoin::CoinDenomination> listDenomsSpent = ZerocoinSpendListFromBlock(block, true);
 
         //Reset the supply to previous block
-        pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
+        pindex->nZerocoinSupply = pindex->pprev->nZerocoinSupply;
 
         //Add mints to zZNN supply
         for (auto denom : libzerocoin::zerocoinDenomList) {
-            long nDenomAdded = count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
-            pindex->mapZerocoinSupply.at(denom) += nDenomAdded;
+            pindex->AddZcMints(denom, pindex->GetMintsInBlock(denom));
         }
 
         //Remove spends from zZNN supply
         for (auto denom : listDenomsSpent)
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->AddZcMints(denom, -1);
 
         // Add inflation from Wrapped Serials if block is Zerocoin_Block_EndFakeSerial()
         if (pindex->nHeight == Params().Zerocoin_Block_EndFakeSerial() + 1)
             for (auto denom : libzerocoin::zerocoinDenomList) {
-                pindex->mapZerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
+                pindex->AddZcMints(denom, GetWrapppedSerialInflation(denom));
             }
 
         //Rewrite money supply
@@ -2828,21 +3011,18 @@ bool UpdateZZNNSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
     std::list<libzerocoin::CoinDenomination> listSpends = ZerocoinSpendListFromBlock(block, fFilterInvalid);
 
     // Initialize zerocoin supply to the supply from previous block
-    if (pindex->pprev && pindex->pprev->GetBlockHeader().nVersion > 3) {
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) = pindex->pprev->GetZcMints(denom);
-        }
-    }
+    if (pindex->pprev && pindex->pprev->GetBlockHeader().nVersion > 3)
+        pindex->nZerocoinSupply = pindex->pprev->nZerocoinSupply;
 
     // Track zerocoin money supply
     CAmount nAmountZerocoinSpent = 0;
-    pindex->vMintDenominationsInBlock.clear();
+    pindex->ClearMintsInBlock();
     if (pindex->pprev) {
         std::set<uint256> setAddedToWallet;
         for (auto& m : listMints) {
             libzerocoin::CoinDenomination denom = m.GetDenomination();
-            pindex->vMintDenominationsInBlock.push_back(m.GetDenomination());
-            pindex->mapZerocoinSupply.at(denom)++;
+            pindex->AddMintInBlock(denom);
+            pindex->AddZcMints(denom, 1);
 
             //Remove any of our own mints from the mintpool
             if (!fJustCheck && pwalletMain) {
@@ -2867,7 +3047,7 @@ bool UpdateZZNNSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
         }
 
         for (auto& denom : listSpends) {
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->AddZcMints(denom, -1);
             nAmountZerocoinSpent += libzerocoin::ZerocoinDenominationToAmount(denom);
 
             // zerocoin failsafe
@@ -2877,14 +3057,14 @@ bool UpdateZZNNSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
     }
 
     for (auto& denom : libzerocoin::zerocoinDenomList)
-        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->mapZerocoinSupply.at(denom));
+        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->GetZcMints(denom));
 
     // Update Wrapped Serials amount
     // A one-time event where only the zZNN supply was off (due to serial duplication off-chain on main net)
     if (Params().NetworkID() == CBaseChainParams::MAIN && pindex->nHeight == Params().Zerocoin_Block_EndFakeSerial() + 1
             && pindex->GetZerocoinSupply() < Params().GetSupplyBeforeFakeSerial() + GetWrapppedSerialInflationAmount()) {
         for (auto denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
+            pindex->AddZcMints(denom, GetWrapppedSerialInflation(denom));
         }
     }
     return true;
@@ -3225,9 +3405,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Flush spend/mint info to disk
     if (!zerocoinDB->WriteCoinSpendBatch(vSpends)) return state.Abort(("Failed to record coin serials to database"));
     if (!zerocoinDB->WriteCoinMintBatch(vMints)) return state.Abort(("Failed to record new mints to database"));
+    if (pindex->nHeight >= Params().Zerocoin_StartHeight() && !IndexBlockMints(block, pindex))
+        return state.Abort(("Failed to record block mints to database"));
+
+    //Track pillar collaterals
+    if (!fVerifyingBlocks && !mnodeman.ConnectPillarBlock(block, pindex))
+        return state.Abort(("Failed to record pillar collaterals to database"));
 
     //Record accumulator checksums
     DatabaseChecksums(mapAccumulators);
+    AddChecksumHeights(pindex);
 
     if (fTxIndex)
         if (!pblocktree->WriteTxIndex(vPos))
@@ -3334,6 +3521,7 @@ void FlushStateToDisk()
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    ResetTipCoinsCache();
 
     /* Zerocoin minting is disabled
      *
@@ -3400,13 +3588,24 @@ bool static DisconnectTip(CValidationState& state)
     if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
         return false;
     // Resurrect mempool transactions from the disconnected block.
+    std::vector<uint256> vHashUpdate;
     for (const CTransaction& tx : block.vtx) {
         // ignore validation errors in resurrected transactions
         std::list<CTransaction> removed;
         CValidationState stateDummy;
-        if (tx.IsCoinBase() || tx.IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL))
+        if (tx.IsCoinBase() || tx.IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL, false, false, true))
             mempool.remove(tx, removed, true);
-    }
+        else if (mempool.exists(tx.GetHash()))
+            vHashUpdate.push_back(tx.GetHash());
+    }
+    // AcceptToMemoryPool/addUnchecked assume that new mempool entries have
+    // no in-mempool children, which is generally not true when adding
+    // previously-confirmed transactions back to the mempool.
+    // UpdateTransactionsFromBlock finds descendants of any transactions in this
+    // block that were added back and cleans up the mempool state.
+    mempool.UpdateTransactionsFromBlock(vHashUpdate);
+    // The resurrected transactions were let in above the limit, evict once all of them are back
+    LimitMempoolSize(mempool);
     mempool.removeCoinbaseSpends(pcoinsTip, pindexDelete->nHeight);
     mempool.check(pcoinsTip);
     // Update chainActive and related variables.
@@ -3879,8 +4078,8 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = NewBlockIndex();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -4202,13 +4401,18 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     std::vector<CBigNum> vBlockSerials;
     // TODO: Check if this is ok... blockHeight is always the tip or should we look for the prevHash and get the height?
     int blockHeight = chainActive.Height() + 1;
+    // CheckTransaction takes cs_main, which CheckBlock is entered with or without, so the proofs
+    // are only handed to the check queue (and its control lock taken) once they are collected
+    std::vector<CZerocoinSpendCheck> vZerocoinChecks;
     for (const CTransaction& tx : block.vtx) {
         if (!CheckTransaction(
                 tx,
                 fZerocoinActive,
                 blockHeight >= Params().Zerocoin_Block_EnforceSerialRange(),
                 state,
-                isBlockBetweenFakeSerialAttackRange(blockHeight)
+                isBlockBetweenFakeSerialAttackRange(blockHeight),
+                false,
+                nScriptCheckThreads ? &vZerocoinChecks : NULL
         ))
             return error("%s : CheckTransaction failed", __func__);
 
@@ -4237,6 +4441,12 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         }
     }
 
+    // Verify the zerocoin spend proofs on the check queue
+    CCheckQueueControl<CZerocoinSpendCheck> control(nScriptCheckThreads ? &zerocoinspendcheckqueue : NULL);
+    control.Add(vZerocoinChecks);
+    if (!control.Wait())
+        return state.DoS(100, error("%s : zerocoin spend proof verification failed", __func__),
+            REJECT_INVALID, "bad-txns-invalid-zcspend");
 
     unsigned int nSigOps = 0;
     for (const CTransaction& tx : block.vtx) {
@@ -4741,31 +4951,6 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
                 return state.Abort("Failed to write block");
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
             return error("AcceptBlock() : ReceivedBlockTransactions failed");
-
-        //check for Pillar vout
-        if((unsigned int)pindex -> nHeight >= PLI_START){    
-            std::vector<CTransaction> current_txs = block.vtx;
-            for(int i = 0; i < (int)current_txs.size(); i++){
-                for(int j = 0; j < (int)current_txs[i].vout.size(); j++){
-                    CTxOut temp_vout = current_txs[i].vout[j];
-                    if(temp_vout.nValue == MNP * COIN){
-                        if((unsigned int)pindex -> nHeight <= PLI_END)
-                            mnodeman.IncrementMaxPillarsAllowed();
-                        
-                        COutPoint temp_outpoint(current_txs[i].GetHash(), j);
-                        mnodeman.AddPillarUtxo(temp_outpoint, std::make_pair(pindex -> nHeight, i));
-                    }
-                }
-                for(int j = 0; j < (int)current_txs[i].vin.size(); j++)
-                    if(mnodeman.IsPillar(current_txs[i].vin[j].prevout)){
-                        if((unsigned int)pindex -> nHeight <= PLI_END)
-                            mnodeman.DecrementMaxPillarsAllowed();
-                        
-                        mnodeman.DeletePillarUtxo(current_txs[i].vin[j].prevout);
-                    }
-            }
-            mnodeman.UpdateLastScannedBlock(pindex -> nHeight);
-        }
     } catch (std::runtime_error& e) {
         return state.Abort(std::string("System error: ") + e.what());
     }
@@ -5019,9 +5204,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = NewBlockIndex();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
 
     pindexNew->phashBlock = &((*mi).first);
@@ -5227,6 +5410,7 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    ResetTipCoinsCache();
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
     mempool.clear();
@@ -5245,10 +5429,8 @@ void UnloadBlockIndex()
     setDirtyFileInfo.clear();
     mapNodeState.clear();
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    FreeBlockIndexes();
 }
 
 bool LoadBlockIndex(std::string& strError)
@@ -5601,7 +5783,48 @@ std::string GetWarnings(std::string strFor)
 //
 
 
-bool static AlreadyHave(const CInv& inv)
+// Held while a message of one family of concurrent messages is processed, see IsConcurrentMessage.
+// Their handlers may wait for cs_main, so code holding cs_main only tries these.
+static CCriticalSection cs_mnListMessages;
+static CCriticalSection cs_budgetMessages;
+static CCriticalSection cs_mnPaymentMessages;
+
+// Set when a node's getdata waits for one of these, the concurrent message handlers wake up the
+// ordered lane once they release theirs
+static std::atomic<bool> fAnyGetDataDeferred(false);
+
+// Set when a concurrent message waits for cs_main, the ordered lane wakes up the concurrent
+// message handlers once it is done with a node
+static std::atomic<bool> fAnyMessageDeferred(false);
+
+static CCriticalSection* GetConcurrentMessageLock(const std::string& strCommand)
+{
+    if (strCommand == "mnb" || strCommand == "mnp" || strCommand == "dseg")
+        return &cs_mnListMessages;
+    if (strCommand == "mnvs" || strCommand == "mprop" || strCommand == "mvote")
+        return &cs_budgetMessages;
+    if (strCommand == "mnget" || strCommand == "mnw")
+        return &cs_mnPaymentMessages;
+    return NULL;
+}
+
+// The family lock guarding what is looked up for an inv type, if any
+static CCriticalSection* GetConcurrentInvLock(int nType)
+{
+    switch (nType) {
+    case MSG_MASTERNODE_ANNOUNCE:
+    case MSG_MASTERNODE_PING:
+        return &cs_mnListMessages;
+    case MSG_BUDGET_VOTE:
+    case MSG_BUDGET_PROPOSAL:
+        return &cs_budgetMessages;
+    case MSG_MASTERNODE_WINNER:
+        return &cs_mnPaymentMessages;
+    }
+    return NULL;
+}
+
+bool static AlreadyHaveUnlocked(const CInv& inv)
 {
     switch (inv.type) {
     case MSG_TX: {
@@ -5620,8 +5843,10 @@ bool static AlreadyHave(const CInv& inv)
                mapTxLockReqRejected.count(inv.hash);
     case MSG_TXLOCK_VOTE:
         return mapTxLockVote.count(inv.hash);
-    case MSG_SPORK:
+    case MSG_SPORK: {
+        LOCK(cs_mapSporks);
         return mapSporks.count(inv.hash);
+    }
     case MSG_MASTERNODE_WINNER:
         if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
             masternodeSync.AddedMasternodeWinner(inv.hash);
@@ -5653,14 +5878,32 @@ bool static AlreadyHave(const CInv& inv)
     return true;
 }
 
+bool static AlreadyHave(const CInv& inv)
+{
+    CCriticalSection* pcsMessages = GetConcurrentInvLock(inv.type);
+    if (pcsMessages) {
+        // the object may be half way through its handler, ask for it again rather than wait
+        TRY_LOCK(*pcsMessages, lockMessages);
+        if (!lockMessages)
+            return false;
+        return AlreadyHaveUnlocked(inv);
+    }
+    return AlreadyHaveUnlocked(inv);
+}
+
 
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
 
     std::vector<CInv> vNotFound;
+    // Masternode objects busy in a concurrent message handler go back to the queue, see fGetDataDeferred
+    std::vector<CInv> vDeferred;
 
     LOCK(cs_main);
+    TRY_LOCK(cs_mnListMessages, lockMnList);
+    TRY_LOCK(cs_budgetMessages, lockBudget);
+    TRY_LOCK(cs_mnPaymentMessages, lockMnPayment);
 
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -5668,6 +5911,14 @@ void static ProcessGetData(CNode* pfrom)
             break;
 
         const CInv& inv = *it;
+        CCriticalSection* pcsMessages = GetConcurrentInvLock(inv.type);
+        if ((pcsMessages == &cs_mnListMessages && !lockMnList) ||
+            (pcsMessages == &cs_budgetMessages && !lockBudget) ||
+            (pcsMessages == &cs_mnPaymentMessages && !lockMnPayment)) {
+            vDeferred.push_back(inv);
+            it++;
+            continue;
+        }
         {
             boost::this_thread::interruption_point();
             it++;
@@ -5813,10 +6064,16 @@ void static ProcessGetData(CNode* pfrom)
                     }
                 }
                 if (!pushed && inv.type == MSG_SPORK) {
-                    if (mapSporks.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapSporks[inv.hash];
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    {
+                        LOCK(cs_mapSporks);
+                        std::map<uint256, CSporkMessage>::iterator mi = mapSporks.find(inv.hash);
+                        if (mi != mapSporks.end()) {
+                            ss.reserve(1000);
+                            ss << mi->second;
+                        }
+                    }
+                    if (!ss.empty()) {
                         pfrom->PushMessage("spork", ss);
                         pushed = true;
                     }
@@ -5895,7 +6152,12 @@ void static ProcessGetData(CNode* pfrom)
         }
     }
 
+    // nothing else is left to answer when the deferred requests are all that remain
+    pfrom->fGetDataDeferred = !vDeferred.empty() && it == pfrom->vRecvGetData.end();
+    if (pfrom->fGetDataDeferred)
+        fAnyGetDataDeferred = true;
     pfrom->vRecvGetData.erase(pfrom->vRecvGetData.begin(), it);
+    pfrom->vRecvGetData.insert(pfrom->vRecvGetData.begin(), vDeferred.begin(), vDeferred.end());
 
     if (!vNotFound.empty()) {
         // Let the peer know that we didn't find what it asked for, so it doesn't
@@ -6825,7 +7087,7 @@ int ActiveProtocol()
 }
 
 // requires LOCK(cs_vRecvMsg)
-bool ProcessMessages(CNode* pfrom)
+bool ProcessMessages(CNode* pfrom, MessageHandlerLane lane)
 {
     //if (fDebug)
     //    LogPrintf("ProcessMessages(%u messages)\n", pfrom->vRecvMsg.size());
@@ -6840,6 +7102,13 @@ bool ProcessMessages(CNode* pfrom)
     //
     bool fOk = true;
 
+    if (lane == MSGLANE_CONCURRENT)
+        pfrom->fMessageDeferred = false;
+
+    // getdata is answered on the ordered lane, and everything after it waits for that
+    if (lane == MSGLANE_CONCURRENT && !pfrom->vRecvGetData.empty())
+        return fOk;
+
     if (!pfrom->vRecvGetData.empty())
         ProcessGetData(pfrom);
 
@@ -6864,6 +7133,10 @@ bool ProcessMessages(CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // leave the message to the thread serving its lane
+        if (lane != MSGLANE_ALL && IsConcurrentMessage(msg.hdr.GetCommand()) != (lane == MSGLANE_CONCURRENT))
+            break;
+
         // at this point, any failure means we can delete the current message
         it++;
 
@@ -6898,8 +7171,29 @@ bool ProcessMessages(CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        bool fDeferred = false;
         try {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            CCriticalSection* pcsMessages = GetConcurrentMessageLock(strCommand);
+            if (pcsMessages) {
+                {
+                    LOCK(*pcsMessages);
+                    if (lane == MSGLANE_CONCURRENT) {
+                        // the handlers read the chain, coins and pillar state that blocks being
+                        // connected on the ordered lane change, try again later while it is busy
+                        TRY_LOCK(cs_main, lockMain);
+                        if (lockMain)
+                            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+                        else
+                            fDeferred = true;
+                    } else {
+                        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+                    }
+                }
+                if (fAnyGetDataDeferred.exchange(false))
+                    WakeupMessageHandler(MSGLANE_ORDERED);
+            } else {
+                fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            }
             boost::this_thread::interruption_point();
         } catch (std::ios_base::failure& e) {
             pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, std::string("error parsing message"));
@@ -6920,6 +7214,14 @@ bool ProcessMessages(CNode* pfrom)
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
 
+        if (fDeferred) {
+            // leave the message at the front of the queue
+            --it;
+            pfrom->fMessageDeferred = true;
+            fAnyMessageDeferred = true;
+            break;
+        }
+
         if (!fRet)
             LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
 
@@ -6930,6 +7232,9 @@ bool ProcessMessages(CNode* pfrom)
     if (!pfrom->fDisconnect)
         pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin(), it);
 
+    if (lane == MSGLANE_ORDERED && fAnyMessageDeferred.exchange(false))
+        WakeupMessageHandler(MSGLANE_CONCURRENT);
+
     return fOk;
 }
 
@@ -6974,6 +7279,8 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (!lockMain)
             return true;
 
+        ApplyPendingMisbehavior();
+
         // Address refresh broadcast
         static int64_t nLastRebroadcast;
         if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60)) {
@@ -7227,10 +7534,8 @@ public:
     ~CMainCleanup()
     {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        FreeBlockIndexes();
 
         // orphan transactions
         mapOrphanTransactions.clear();
@@ -492,13 +492,65 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
             CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
             mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
         }
-    }
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+        CMasternodeBlockPayees& blockPayees = mapMasternodeBlocks[winnerIn.nBlockHeight];
+        blockPayees.AddPayee(winnerIn.payee, 1);
+        if (blockPayees.HasPayeeWithVotes(winnerIn.payee, 2))
+            mapPayeeHeights[winnerIn.payee].insert(winnerIn.nBlockHeight);
+    }
 
     return true;
 }
 
+void CMasternodePayments::IndexBlockPayees(int nBlockHeight, const CMasternodeBlockPayees& blockPayees)
+{
+    LOCK(cs_vecPayments);
+    for (const CMasternodePayee& payee : blockPayees.vecPayments) {
+        if (payee.nVotes >= 2)
+            mapPayeeHeights[payee.scriptPubKey].insert(nBlockHeight);
+    }
+}
+
+void CMasternodePayments::UnindexBlockPayees(int nBlockHeight, const CMasternodeBlockPayees& blockPayees)
+{
+    LOCK(cs_vecPayments);
+    for (const CMasternodePayee& payee : blockPayees.vecPayments) {
+        std::map<CScript, std::set<int> >::iterator it = mapPayeeHeights.find(payee.scriptPubKey);
+        if (it == mapPayeeHeights.end())
+            continue;
+        it->second.erase(nBlockHeight);
+        if (it->second.empty())
+            mapPayeeHeights.erase(it);
+    }
+}
+
+void CMasternodePayments::ReindexPayees()
+{
+    LOCK(cs_mapMasternodeBlocks);
+    mapPayeeHeights.clear();
+    for (const std::pair<const int, CMasternodeBlockPayees>& it : mapMasternodeBlocks)
+        IndexBlockPayees(it.first, it.second);
+}
+
+int CMasternodePayments::GetLastPaidHeight(const CScript& payee, int nHeight, int nDepth)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    std::map<CScript, std::set<int> >::const_iterator it = mapPayeeHeights.find(payee);
+    if (it == mapPayeeHeights.end())
+        return 0;
+
+    // Votes for blocks ahead of nHeight do not count
+    std::set<int>::const_iterator itHeight = it->second.upper_bound(nHeight);
+    if (itHeight == it->second.begin())
+        return 0;
+    --itHeight;
+
+    if (*itHeight <= nHeight - nDepth || *itHeight <= 0)
+        return 0;
+    return *itHeight;
+}
+
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_vecPayments);
@@ -626,7 +678,11 @@ void CMasternodePayments::CleanPaymentList()
             LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
             masternodeSync.mapSeenSyncMNW.erase((*it).first);
             mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
+            std::map<int, CMasternodeBlockPayees>::iterator itBlock = mapMasternodeBlocks.find(winner.nBlockHeight);
+            if (itBlock != mapMasternodeBlocks.end()) {
+                UnindexBlockPayees(itBlock->first, itBlock->second);
+                mapMasternodeBlocks.erase(itBlock);
+            }
         } else {
             ++it;
         }
@@ -11,6 +11,8 @@
 #include "main.h"
 #include "masternode.h"
 
+#include <set>
+
 
 extern CCriticalSection cs_vecPayments;
 extern CCriticalSection cs_mapMasternodeBlocks;
@@ -235,6 +237,14 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // Heights of mapMasternodeBlocks at which each payee has at least two votes,
+    // so a masternode's last payment is found without walking back the chain
+    std::map<CScript, std::set<int> > mapPayeeHeights;
+
+    void IndexBlockPayees(int nBlockHeight, const CMasternodeBlockPayees& blockPayees);
+    void UnindexBlockPayees(int nBlockHeight, const CMasternodeBlockPayees& blockPayees);
+    void ReindexPayees();
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -251,6 +261,7 @@ public:
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapPayeeHeights.clear();
     }
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
@@ -259,6 +270,8 @@ public:
     void Sync(CNode* node, int nCountNeeded);
     void CleanPaymentList();
     int LastPayment(CMasternode& mn);
+    // Highest height in (nHeight - nDepth, nHeight] at which payee has at least two votes, or 0 if there is none
+    int GetLastPaidHeight(const CScript& payee, int nHeight, int nDepth);
 
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
@@ -294,6 +307,8 @@ public:
     {
         READWRITE(mapMasternodePayeeVotes);
         READWRITE(mapMasternodeBlocks);
+        if (ser_action.ForRead())
+            ReindexPayees();
     }
 };
 
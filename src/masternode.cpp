@@ -9,6 +9,7 @@
 #include "masternodeman.h"
 #include "obfuscation.h"
 #include "spork.h"
+#include "swifttx.h"
 #include "sync.h"
 #include "util.h"
 
@@ -184,67 +185,96 @@ uint256 CMasternode::CalculateScore(int mod, int64_t nBlockHeight)
     return r;
 }
 
-void CMasternode::Check(bool forceCheck)
+bool CMasternode::CheckPing(bool forceCheck)
 {
-    if (ShutdownRequested()) return;
+    if (ShutdownRequested()) return false;
 
-    if (!forceCheck && (GetTime() - lastTimeChecked < MASTERNODE_CHECK_SECONDS)) return;
+    if (!forceCheck && (GetTime() - lastTimeChecked < MASTERNODE_CHECK_SECONDS)) return false;
     lastTimeChecked = GetTime();
 
 
     //once spent, stop doing the checks
-    if (activeState == MASTERNODE_VIN_SPENT) return;
+    if (activeState == MASTERNODE_VIN_SPENT) return false;
 
 
     if (!IsPingedWithin(MASTERNODE_REMOVAL_SECONDS)) {
         activeState = MASTERNODE_REMOVE;
-        return;
+        return false;
     }
 
     if (!IsPingedWithin(MASTERNODE_EXPIRATION_SECONDS)) {
         activeState = MASTERNODE_EXPIRED;
-        return;
+        return false;
     }
 
     if(lastPing.sigTime - sigTime < MASTERNODE_MIN_MNP_SECONDS){
     	activeState = MASTERNODE_PRE_ENABLED;
-    	return;
+    	return false;
     }
 
-    if (!unitTest) {
-        CValidationState state;
-        CMutableTransaction tx = CMutableTransaction();
-        CTxOut vout;
-        
-        if(mnodeman.IsPillar(vin.prevout)){
-            vout = CTxOut(MNP2 * COIN, obfuScationPool.collateralPubKey);
-        }else{
-            vout = CTxOut(MNA2 * COIN, obfuScationPool.collateralPubKey);
-        }
+    return true;
+}
 
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-        
-        {
-            TRY_LOCK(cs_main, lockMain);
-            if (!lockMain) return;
+bool CMasternode::IsCollateralUnspent()
+{
+    AssertLockHeld(cs_main);
 
-            if (!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)) {
-                activeState = MASTERNODE_VIN_SPENT;
-                return;
-            }
+    // locked by a swiftTX or spent by a transaction waiting in the mempool
+    if (mapLockedInputs.count(vin.prevout))
+        return false;
+    {
+        LOCK(mempool.cs);
+        if (mempool.mapNextTx.count(vin.prevout))
+            return false;
+    }
+
+    if (!ValidOutPoint(vin.prevout, chainActive.Height()))
+        return false;
+
+    // the output must be unspent in the chain, or created by a mempool transaction
+    CAmount nValue = 0;
+    const CCoins* coins = pcoinsTip->AccessCoins(vin.prevout.hash);
+    if (coins) {
+        if (!coins->IsAvailable(vin.prevout.n))
+            return false;
+        nValue = coins->vout[vin.prevout.n].nValue;
+    } else {
+        CTransaction tx;
+        if (!mempool.lookup(vin.prevout.hash, tx) || vin.prevout.n >= tx.vout.size())
+            return false;
+        nValue = tx.vout[vin.prevout.n].nValue;
+    }
+
+    CAmount nCollateral = mnodeman.IsPillar(vin.prevout) ? MNP2 * COIN : MNA2 * COIN;
+    return nValue >= nCollateral;
+}
+
+void CMasternode::CheckCollateral(bool fUnspent)
+{
+    activeState = fUnspent ? MASTERNODE_ENABLED : MASTERNODE_VIN_SPENT;
+}
+
+void CMasternode::Check(bool forceCheck)
+{
+    if (!CheckPing(forceCheck)) return;
+
+    if (!unitTest) {
+        TRY_LOCK(cs_main, lockMain);
+        if (!lockMain) {
+            // try again on the next check rather than after MASTERNODE_CHECK_SECONDS
+            DeferCheck();
+            return;
         }
+        CheckCollateral(IsCollateralUnspent());
+        return;
     }
 
     activeState = MASTERNODE_ENABLED; // OK
 }
 
-int64_t CMasternode::SecondsSincePayment()
+int64_t CMasternode::SecondsSincePayment(int nMnCount)
 {
-    CScript pubkeyScript;
-    pubkeyScript = GetScriptForDestination(pubKeyCollateralAddress.GetID());
-
-    int64_t sec = (GetAdjustedTime() - GetLastPaid());
+    int64_t sec = (GetAdjustedTime() - GetLastPaid(nMnCount));
     int64_t month = 60 * 60 * 24 * 30;
     if (sec < month) return sec; //if it's less than 30 days, give seconds
 
@@ -258,6 +288,11 @@ int64_t CMasternode::SecondsSincePayment()
 }
 
 int64_t CMasternode::GetLastPaid()
+{
+    return GetLastPaid(mnodeman.CountEnabled());
+}
+
+int64_t CMasternode::GetLastPaid(int nMnCount)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
     if (pindexPrev == NULL) return false;
@@ -273,36 +308,16 @@ int64_t CMasternode::GetLastPaid()
     // use a deterministic offset to break a tie -- 2.5 minutes
     int64_t nOffset = hash.GetCompact(false) % 150;
 
-    if (chainActive.Tip() == NULL) return false;
-
-    const CBlockIndex* BlockReading = chainActive.Tip();
-
-    int nMnCount = mnodeman.CountEnabled() * 1.25;
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if (n >= nMnCount) {
-            return 0;
-        }
-        n++;
-
-        if (masternodePayments.mapMasternodeBlocks.count(BlockReading->nHeight)) {
-            /*
-                Search for this payee, with at least 2 votes. This will aid in consensus allowing the network
-                to converge on the same payees quickly, then keep the same schedule.
-            */
-            if (masternodePayments.mapMasternodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2)) {
-                return BlockReading->nTime + nOffset;
-            }
-        }
-
-        if (BlockReading->pprev == NULL) {
-            assert(BlockReading);
-            break;
-        }
-        BlockReading = BlockReading->pprev;
-    }
+    /*
+        Search for this payee, with at least 2 votes, in the last 1.25 cycles. This will aid in consensus
+        allowing the network to converge on the same payees quickly, then keep the same schedule.
+    */
+    int nDepth = nMnCount * 1.25;
+    int nHeight = masternodePayments.GetLastPaidHeight(mnpayee, pindexPrev->nHeight, nDepth);
+    if (nHeight == 0)
+        return 0;
 
-    return 0;
+    return chainActive[nHeight]->nTime + nOffset;
 }
 
 std::string CMasternode::GetStatus()
@@ -560,7 +575,7 @@ bool CMasternodeBroadcast::CheckAndUpdate(int& nDos)
     if (pmn->pubKeyCollateralAddress == pubKeyCollateralAddress && !pmn->IsBroadcastedWithin(MASTERNODE_MIN_MNB_SECONDS)) {
         //take the newest entry
         LogPrint("masternode","mnb - Got updated entry for %s\n", vin.prevout.hash.ToString());
-        if (pmn->UpdateFromNewBroadcast((*this))) {
+        if (mnodeman.UpdateFromNewBroadcast(*pmn, *this)) {
             pmn->Check();
             if (pmn->IsEnabled()) Relay();
         }
@@ -618,32 +633,32 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
             state.IsInvalid(nDoS);
             return false;
         }
-    }
 
-    LogPrint("masternode", "mnb - Accepted Masternode entry\n");
+        LogPrint("masternode", "mnb - Accepted Masternode entry\n");
 
-    if (GetInputAge(vin) < MASTERNODE_MIN_CONFIRMATIONS) {
-        LogPrint("masternode","mnb - Input must have at least %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS);
-        // maybe we miss few blocks, let this mnb to be checked again later
-        mnodeman.mapSeenMasternodeBroadcast.erase(GetHash());
-        masternodeSync.mapSeenSyncMNB.erase(GetHash());
-        return false;
-    }
-
-    // verify that sig time is legit in past
-    // should be at least not earlier than block when 5000 ZNN tx got MASTERNODE_MIN_CONFIRMATIONS
-    uint256 hashBlock = 0;
-    CTransaction tx2;
-    GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi != mapBlockIndex.end() && (*mi).second) {
-        CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 1000 Zenon tx -> 1 confirmation
-        CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
-        if (pConfIndex->GetBlockTime() > sigTime) {
-            LogPrint("masternode","mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
-                sigTime, vin.prevout.hash.ToString(), MASTERNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
+        if (GetInputAge(vin) < MASTERNODE_MIN_CONFIRMATIONS) {
+            LogPrint("masternode","mnb - Input must have at least %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS);
+            // maybe we miss few blocks, let this mnb to be checked again later
+            mnodeman.mapSeenMasternodeBroadcast.erase(GetHash());
+            masternodeSync.mapSeenSyncMNB.erase(GetHash());
             return false;
         }
+
+        // verify that sig time is legit in past
+        // should be at least not earlier than block when 5000 ZNN tx got MASTERNODE_MIN_CONFIRMATIONS
+        uint256 hashBlock = 0;
+        CTransaction tx2;
+        GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi != mapBlockIndex.end() && (*mi).second) {
+            CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 1000 Zenon tx -> 1 confirmation
+            CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
+            if (pConfIndex->GetBlockTime() > sigTime) {
+                LogPrint("masternode","mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
+                    sigTime, vin.prevout.hash.ToString(), MASTERNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
+                return false;
+            }
+        }
     }
 
     LogPrint("masternode","mnb - Got NEW Masternode entry - %s - %lli \n", vin.prevout.hash.ToString(), sigTime);
@@ -804,6 +819,13 @@ bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fChec
         	if (!VerifySignature(pmn->pubKeyMasternode, nDos))
                 return false;
 
+            TRY_LOCK(cs_main, lockMain);
+            if (!lockMain) {
+                // not mnp fault, let it to be checked again later
+                mnodeman.mapSeenMasternodePing.erase(GetHash());
+                return false;
+            }
+
             BlockMap::iterator mi = mapBlockIndex.find(blockHash);
             if (mi != mapBlockIndex.end() && (*mi).second) {
                 if ((*mi).second->nHeight < chainActive.Height() - 24) {
@@ -219,7 +219,7 @@ public:
         READWRITE(isPillar);
     }
 
-    int64_t SecondsSincePayment();
+    int64_t SecondsSincePayment(int nMnCount);
 
     bool UpdateFromNewBroadcast(CMasternodeBroadcast& mnb);
 
@@ -231,6 +231,17 @@ public:
     }
 
     void Check(bool forceCheck = false);
+    // The part of Check() not depending on the collateral, returns true when the collateral decides the state
+    bool CheckPing(bool forceCheck = false);
+    // Whether the collateral is still unspent in the chain and the mempool, requires cs_main
+    bool IsCollateralUnspent();
+    // Finish Check() with the result of IsCollateralUnspent()
+    void CheckCollateral(bool fUnspent);
+    // Check again on the next call, when the collateral could not be looked up
+    void DeferCheck()
+    {
+        lastTimeChecked = 0;
+    }
 
     bool IsBroadcastedWithin(int seconds)
     {
@@ -284,6 +295,8 @@ public:
     }
 
     int64_t GetLastPaid();
+    // Same as GetLastPaid(), for callers that already counted the nMnCount enabled masternodes
+    int64_t GetLastPaid(int nMnCount);
     bool IsValidNetAddr();
 };
 
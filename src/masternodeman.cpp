@@ -10,6 +10,7 @@
 #include "masternode.h"
 #include "obfuscation.h"
 #include "spork.h"
+#include "txdb.h"
 #include "util.h"
 #include <boost/filesystem.hpp>
 #include <stdlib.h>
@@ -18,6 +19,7 @@
 #include <main.h>
 
 #define MN_WINNER_MINIMUM_AGE 8000    // Age in seconds. This should be > MASTERNODE_REMOVAL_SECONDS to avoid misconfigured new nodes in the list.
+#define MNSCORE_CACHE_HEIGHTS 32      // Number of block heights whose masternode score tables are kept.
 
 /** Masternode manager */
 CMasternodeMan mnodeman;
@@ -36,22 +38,6 @@ struct CompareLastPaid {
     }
 };
 
-struct CompareScoreTxIn {
-    bool operator()(const std::pair<int64_t, CTxIn>& t1,
-        const std::pair<int64_t, CTxIn>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
-struct CompareScoreMN {
-    bool operator()(const std::pair<int64_t, CMasternode>& t1,
-        const std::pair<int64_t, CMasternode>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 //
 // CMasternodeDB
 //
@@ -203,9 +189,15 @@ void DumpMasternodes()
     LogPrint("masternode","Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
+CMasternodeKeyHasher::CMasternodeKeyHasher()
+{
+    salt = GetRandHash();
+}
+
 CMasternodeMan::CMasternodeMan()
 {
     nDsqCount = 0;
+    fPillarsLoaded = false;
 }
 
 bool CMasternodeMan::Add(CMasternode& mn)
@@ -228,6 +220,8 @@ bool CMasternodeMan::Add(CMasternode& mn)
             }
         }
         vMasternodes.push_back(mn);
+        IndexMasternode(vMasternodes.size() - 1);
+        mapScoreCache.clear();
         return true;
     }
 
@@ -254,9 +248,28 @@ void CMasternodeMan::Check()
 {
     LOCK(cs);
 
+    // Look up the collaterals of all masternodes due for a check under a single cs_main lock
+    std::vector<CMasternode*> vCollateralChecks;
     for (CMasternode& mn : vMasternodes) {
-        mn.Check();
+        if (!mn.CheckPing())
+            continue;
+        if (mn.unitTest)
+            mn.activeState = CMasternode::MASTERNODE_ENABLED;
+        else
+            vCollateralChecks.push_back(&mn);
     }
+    if (vCollateralChecks.empty())
+        return;
+
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain) {
+        // try again on the next check rather than after MASTERNODE_CHECK_SECONDS
+        for (CMasternode* pmn : vCollateralChecks)
+            pmn->DeferCheck();
+        return;
+    }
+    for (CMasternode* pmn : vCollateralChecks)
+        pmn->CheckCollateral(pmn->IsCollateralUnspent());
 }
 
 void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
@@ -266,6 +279,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     LOCK(cs);
 
     //remove inactive and outdated
+    bool fRemoved = false;
     std::vector<CMasternode>::iterator it = vMasternodes.begin();
     while (it != vMasternodes.end()) {
         if ((*it).activeState == CMasternode::MASTERNODE_REMOVE ||
@@ -298,10 +312,14 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vMasternodes.erase(it);
+            mapScoreCache.clear();
+            fRemoved = true;
         } else {
             ++it;
         }
     }
+    if (fRemoved)
+        ReindexMasternodes();
 
     // check who's asked for the Masternode list
     std::map<CNetAddr, int64_t>::iterator it1 = mAskedUsForMasternodeList.begin();
@@ -359,6 +377,10 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    mapOutpointIndex.clear();
+    mapPayeeIndex.clear();
+    mapPubKeyIndex.clear();
+    mapScoreCache.clear();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -399,8 +421,8 @@ int CMasternodeMan::CountEnabled(int protocolVersion)
     int i = 0;
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
+    Check();
     for (CMasternode& mn : vMasternodes) {
-        mn.Check();
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) 
             continue;
         i++;
@@ -413,8 +435,8 @@ void CMasternodeMan::CountNetworks(int protocolVersion, int& ipv4, int& ipv6, in
 {
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
+    Check();
     for (CMasternode& mn : vMasternodes) {
-        mn.Check();
         std::string strHost;
         int port;
         SplitHostPort(mn.addr.ToString(), port, strHost);
@@ -455,28 +477,62 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 }
 
+void CMasternodeMan::IndexMasternode(size_t nIndex)
+{
+    const CMasternode& mn = vMasternodes[nIndex];
+
+    // an existing entry keeps its slot unless it sits further down the list, lookups return the first match
+    size_t& nOutpoint = mapOutpointIndex.insert(std::make_pair(mn.vin.prevout, nIndex)).first->second;
+    nOutpoint = std::min(nOutpoint, nIndex);
+    size_t& nPayee = mapPayeeIndex.insert(std::make_pair(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()), nIndex)).first->second;
+    nPayee = std::min(nPayee, nIndex);
+    size_t& nPubKey = mapPubKeyIndex.insert(std::make_pair(mn.pubKeyMasternode, nIndex)).first->second;
+    nPubKey = std::min(nPubKey, nIndex);
+}
+
+void CMasternodeMan::ReindexMasternodes()
+{
+    LOCK(cs);
+
+    mapOutpointIndex.clear();
+    mapPayeeIndex.clear();
+    mapPubKeyIndex.clear();
+    for (size_t i = 0; i < vMasternodes.size(); i++)
+        IndexMasternode(i);
+}
+
+bool CMasternodeMan::UpdateFromNewBroadcast(CMasternode& mn, CMasternodeBroadcast& mnb)
+{
+    LOCK(cs);
+
+    CPubKey pubKeyMasternodeOld = mn.pubKeyMasternode;
+    CPubKey pubKeyCollateralAddressOld = mn.pubKeyCollateralAddress;
+    if (!mn.UpdateFromNewBroadcast(mnb))
+        return false;
+    // the masternode key and the payee of the collateral key are indexed
+    if (mn.pubKeyMasternode != pubKeyMasternodeOld || mn.pubKeyCollateralAddress != pubKeyCollateralAddressOld)
+        ReindexMasternodes();
+    return true;
+}
+
 CMasternode* CMasternodeMan::Find(const CScript& payee)
 {
     LOCK(cs);
-    CScript payee2;
 
-    for (CMasternode& mn : vMasternodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
-    }
-    return NULL;
+    std::unordered_map<CScript, size_t, CMasternodeKeyHasher>::const_iterator it = mapPayeeIndex.find(payee);
+    if (it == mapPayeeIndex.end())
+        return NULL;
+    return &vMasternodes[it->second];
 }
 
 CMasternode* CMasternodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
 
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    std::unordered_map<COutPoint, size_t, CMasternodeKeyHasher>::const_iterator it = mapOutpointIndex.find(vin.prevout);
+    if (it == mapOutpointIndex.end())
+        return NULL;
+    return &vMasternodes[it->second];
 }
 
 
@@ -484,11 +540,10 @@ CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
 
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.pubKeyMasternode == pubKeyMasternode)
-            return &mn;
-    }
-    return NULL;
+    std::unordered_map<CPubKey, size_t, CMasternodeKeyHasher>::const_iterator it = mapPubKeyIndex.find(pubKeyMasternode);
+    if (it == mapPubKeyIndex.end())
+        return NULL;
+    return &vMasternodes[it->second];
 }
 
 //
@@ -536,7 +591,6 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     int nMnCount = CountEnabled();
     for (CMasternode& mn : vMasternodes)
         if((mn.isPillar ^ block_winner) == 0){
-            mn.Check();
             if (!mn.IsEnabled()) continue;
             // //check protocol version
             if (mn.protocolVersion < masternodePayments.GetMinMasternodePaymentsProto()) continue;
@@ -547,7 +601,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
             //make sure it has as many confirmations as there are masternodes
             if (mn.GetMasternodeInputAge() < nMnCount) continue;
 
-            vecMasternodeLastPaid.push_back(std::make_pair(mn.SecondsSincePayment(), mn.vin));
+            vecMasternodeLastPaid.push_back(std::make_pair(mn.SecondsSincePayment(nMnCount), mn.vin));
             nCount++;
     }
     //when the network is in the process of upgrading, don't penalize nodes that recently restarted
@@ -563,11 +617,12 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     int nTenthNetwork = CountEnabled() / 10;
     int nCountTenth = 0;
     uint256 nHigh = 0;
+    const CMasternodeScores& scores = GetScores(nBlockHeight - 100);
     for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeLastPaid) {
         CMasternode* pmn = Find(s.second);
         if (!pmn) break;
 
-        uint256 n = pmn->CalculateScore(1, nBlockHeight - 100);
+        uint256 n = scores.vScore[pmn - &vMasternodes[0]];
         if (n > nHigh) {
             nHigh = n;
             pBestMasternode = pmn;
@@ -610,32 +665,66 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude
     return NULL;
 }
 
+const CMasternodeMan::CMasternodeScores& CMasternodeMan::GetScores(int64_t nBlockHeight)
+{
+    LOCK(cs);
+
+    uint256 hash = 0;
+    if (chainActive.Tip() == NULL || !GetBlockHash(hash, nBlockHeight)) {
+        // CalculateScore gives every masternode a zero score, which keeps them in list order
+        scoresUnknownBlock.vScore.assign(vMasternodes.size(), 0);
+        scoresUnknownBlock.vRanked.clear();
+        for (size_t i = 0; i < vMasternodes.size(); i++)
+            scoresUnknownBlock.vRanked.push_back(std::make_pair(0, i));
+        return scoresUnknownBlock;
+    }
+
+    std::map<int64_t, CMasternodeScores>::iterator it = mapScoreCache.find(nBlockHeight);
+    if (it != mapScoreCache.end() && it->second.hashBlock == hash)
+        return it->second;
+
+    if (it == mapScoreCache.end()) {
+        // keep the tables of the most recent heights only
+        if (mapScoreCache.size() >= MNSCORE_CACHE_HEIGHTS)
+            mapScoreCache.erase(mapScoreCache.begin());
+        it = mapScoreCache.insert(std::make_pair(nBlockHeight, CMasternodeScores())).first;
+    }
+
+    CMasternodeScores& scores = it->second;
+    scores.hashBlock = hash;
+    scores.vScore.resize(vMasternodes.size());
+    scores.vRanked.clear();
+    for (size_t i = 0; i < vMasternodes.size(); i++) {
+        scores.vScore[i] = vMasternodes[i].CalculateScore(1, nBlockHeight);
+        scores.vRanked.push_back(std::make_pair(scores.vScore[i].GetCompact(false), i));
+    }
+    // highest first, equal scores stay in list order
+    std::stable_sort(scores.vRanked.begin(), scores.vRanked.end(),
+        [](const std::pair<int64_t, size_t>& a, const std::pair<int64_t, size_t>& b) { return a.first > b.first; });
+    return scores;
+}
+
 CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
-    int64_t score = 0;
-    CMasternode* winner = NULL;
+    LOCK(cs);
 
-    // scan for winner
-    for (CMasternode& mn : vMasternodes){
-        mn.Check();
+    Check();
+
+    // scan for winner, the first one with the highest score above zero
+    for (const std::pair<int64_t, size_t>& s : GetScores(nBlockHeight).vRanked) {
+        if (s.first <= 0) break;
+        CMasternode& mn = vMasternodes[s.second];
         if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
-        // calculate the score for each Masternode
-        uint256 n = mn.CalculateScore(mod, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        // determine the winner
-        if (n2 > score) {
-            score = n2;
-            winner = &mn;
-        }
+        return &mn;
     }
-    
-    return winner;
+
+    return NULL;
 }
 
 int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
+    LOCK(cs);
+
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
@@ -643,8 +732,13 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     uint256 hash = 0;
     if (!GetBlockHash(hash, nBlockHeight)) return -1;
 
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
+    if (fOnlyActive)
+        Check();
+
+    // walk the masternodes by score
+    int rank = 0;
+    for (const std::pair<int64_t, size_t>& s : GetScores(nBlockHeight).vRanked) {
+        CMasternode& mn = vMasternodes[s.second];
         if (mn.protocolVersion < minProtocol) {
             LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
             continue;                                                       // Skip obsolete versions
@@ -657,22 +751,10 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
                 continue;                                                   // Skip masternodes younger than (default) 1 hour
             }
         }
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(n2, mn.vin));
-    }
+        if (fOnlyActive && !mn.IsEnabled()) continue;
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores) {
         rank++;
-        if (s.second.prevout == vin.prevout) {
+        if (mn.vin.prevout == vin.prevout) {
             return rank;
         }
     }
@@ -682,36 +764,38 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
 std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<std::pair<int64_t, CMasternode> > vecMasternodeScores;
+    LOCK(cs);
+
+    std::vector<std::pair<int64_t, size_t> > vecMasternodeScores;
     std::vector<std::pair<int, CMasternode> > vecMasternodeRanks;
 
     //make sure we know about this block
     uint256 hash = 0;
     if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
 
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
-        mn.Check();
+    Check();
 
+    // scan for winner
+    for (const std::pair<int64_t, size_t>& s : GetScores(nBlockHeight).vRanked) {
+        CMasternode& mn = vMasternodes[s.second];
         if (mn.protocolVersion < minProtocol) continue;
 
         if (!mn.IsEnabled()) {
-            vecMasternodeScores.push_back(std::make_pair(9999, mn));
+            vecMasternodeScores.push_back(std::make_pair(9999, s.second));
             continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(n2, mn));
+        vecMasternodeScores.push_back(s);
     }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
+    // disabled masternodes rank as if they scored 9999
+    std::stable_sort(vecMasternodeScores.begin(), vecMasternodeScores.end(),
+        [](const std::pair<int64_t, size_t>& a, const std::pair<int64_t, size_t>& b) { return a.first > b.first; });
 
     int rank = 0;
-    for (PAIRTYPE(int64_t, CMasternode) & s : vecMasternodeScores) {
+    for (const std::pair<int64_t, size_t>& s : vecMasternodeScores) {
         rank++;
-        vecMasternodeRanks.push_back(std::make_pair(rank, s.second));
+        vecMasternodeRanks.push_back(std::make_pair(rank, vMasternodes[s.second]));
     }
 
     return vecMasternodeRanks;
@@ -719,29 +803,21 @@ std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
-
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.protocolVersion < minProtocol) continue;
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(n2, mn.vin));
-    }
+    LOCK(cs);
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    if (fOnlyActive)
+        Check();
 
+    // walk the masternodes by score
     int rank = 0;
-    for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores) {
+    for (const std::pair<int64_t, size_t>& s : GetScores(nBlockHeight).vRanked) {
+        CMasternode& mn = vMasternodes[s.second];
+        if (mn.protocolVersion < minProtocol) continue;
+        if (fOnlyActive && !mn.IsEnabled()) continue;
+
         rank++;
         if (rank == nRank) {
-            return Find(s.second);
+            return &mn;
         }
     }
 
@@ -911,6 +987,8 @@ void CMasternodeMan::Remove(CTxIn vin)
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
             vMasternodes.erase(it);
+            ReindexMasternodes();
+            mapScoreCache.clear();
             break;
         }
         ++it;
@@ -930,7 +1008,7 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
         CMasternode mn(mnb);
         Add(mn);
     } else {
-        pmn->UpdateFromNewBroadcast(mnb);
+        UpdateFromNewBroadcast(*pmn, mnb);
     }
 }
 
@@ -964,6 +1042,7 @@ int CMasternodeMan::PillarCount(int protocolVersion){
 }
 
 bool CMasternodeMan::CanBePillar(const COutPoint& utxo){
+    LOCK(cs);
     if(mPillarCollaterals.count(utxo) > 0){
         for(unsigned int i = 0; i < vPillarCollaterals.size(); i++)
             if(vPillarCollaterals[i].first == utxo){
@@ -980,7 +1059,9 @@ bool CMasternodeMan::CanBePillar(const COutPoint& utxo){
 std::vector<std::pair<int, std::string> > CMasternodeMan::PillarQueuePositions(){
     std::vector<std::pair<int, std::string> > result;
     if(PillarQueueSize() > 0){
+        // the wallet is looked at before taking cs
         std::vector<COutput> possibleUtxos = activeMasternode.SelectCoinsPillar();
+        LOCK(cs);
         for(int i = MAX_PILLARS_ALLOWED; i < (int)vPillarCollaterals.size(); i++){
             COutPoint outpoint(vPillarCollaterals[i].first);
             for(int j = 0; j < (int)possibleUtxos.size(); j++){
@@ -997,11 +1078,13 @@ std::vector<std::pair<int, std::string> > CMasternodeMan::PillarQueuePositions()
 }
 
 void CMasternodeMan::AddPillarUtxo(const COutPoint& first, std::pair<int, int> second){
+    AssertLockHeld(cs);
     vPillarCollaterals.push_back(std::make_pair(first, second));
     mPillarCollaterals.insert(std::make_pair(first, second));
 }
 
 void CMasternodeMan::DeletePillarUtxo(const COutPoint& outpoint){
+    AssertLockHeld(cs);
     mPillarCollaterals.erase(outpoint);
     for(int k = 0; k < (int)vPillarCollaterals.size(); k++)
         if(vPillarCollaterals[k].first == outpoint){
@@ -1023,55 +1106,139 @@ struct less_than_key{
 };
 
 bool CMasternodeMan::InitPillars(){
-    LOCK(cs_main);
+    LOCK2(cs_main, cs);
 
     InitRatios();
-    
-    unsigned int left = last_block_scanned < PLI_START ? PLI_START : last_block_scanned;
-    while(left <= chainActive.Height()){
+
+    // start from the pillar utxo index, unless it was left on a chain that is no longer active
+    uint256 hashBest;
+    unsigned int nMaxPillars;
+    std::vector<std::pair<COutPoint, std::pair<int, int> > > vCollaterals;
+    if(!pblocktree->LoadPillarCollaterals(hashBest, nMaxPillars, vCollaterals))
+        return false;
+
+    CBlockIndex* pindexBest = NULL;
+    if(hashBest != 0){
+        BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+        if(mi != mapBlockIndex.end() && chainActive.Contains(mi->second)){
+            pindexBest = mi->second;
+        }else{
+            LogPrintf("%s: pillar utxo index is not on the active chain, rebuilding\n", __func__);
+            if(!pblocktree->WipePillarCollaterals())
+                return false;
+            nMaxPillars = 0;
+            vCollaterals.clear();
+        }
+    }
+
+    MAX_PILLARS_ALLOWED = nMaxPillars;
+    mPillarCollaterals.clear();
+    vPillarCollaterals.clear();
+    for(auto& itr: vCollaterals)
+        AddPillarUtxo(itr.first, itr.second);
+
+    std::sort(vPillarCollaterals.begin(), vPillarCollaterals.end(), less_than_key());
+
+    hashPillarBest = pindexBest ? pindexBest->GetBlockHash() : uint256(0);
+    last_block_scanned = pindexBest ? pindexBest->nHeight : 0;
+    fPillarsLoaded = true;
+
+    // catch up with the blocks connected since, the first time this scans from PLI_START
+    int left = pindexBest ? pindexBest->nHeight + 1 : PLI_START;
+    if(left < (int)PLI_START)
+        left = PLI_START;
+    for(; left <= chainActive.Height(); left++){
         CBlockIndex* block_index = chainActive[left];
         CBlock current_block;
-        if(ReadBlockFromDisk(current_block, block_index)){
-            int tx_count = 0;
-            for(const CTransaction& current_tx: current_block.vtx){
-                int n = 0;
-                for(const CTxOut current_vout: current_tx.vout){
-                    if(current_vout.nValue == MNP * COIN){
-                        if(left <= PLI_END){
-                            MAX_PILLARS_ALLOWED++;
-                        }
-                        COutPoint temp_outpoint(current_tx.GetHash(), n);
-                        mPillarCollaterals.insert(std::make_pair(temp_outpoint, std::make_pair(left, tx_count)));
-                    }
-                    n++;
-                }
-                for(const CTxIn current_vin : current_tx.vin){
-                    if(mPillarCollaterals.count(current_vin.prevout) > 0){
-                        if(left <= PLI_END){
-                            MAX_PILLARS_ALLOWED--;
-                        }
-                        mPillarCollaterals.erase(current_vin.prevout);
-                    }
-                }
-                tx_count++;
-            }
-            last_block_scanned = left;
-        }else{
+        if(!ReadBlockFromDisk(current_block, block_index))
+            return false;
+        if(!ConnectPillarBlock(current_block, block_index))
             return false;
+    }
+
+    return true;
+}
+
+bool CMasternodeMan::ConnectPillarBlock(const CBlock& block, const CBlockIndex* pindex){
+    AssertLockHeld(cs_main);
+    LOCK(cs);
+
+    // blocks connected before InitPillars are picked up by its catch up
+    if(!fPillarsLoaded || (unsigned int)pindex->nHeight < PLI_START)
+        return true;
+
+    std::vector<std::pair<COutPoint, std::pair<int, int> > > vAdded;
+    std::vector<std::pair<COutPoint, std::pair<int, int> > > vSpent;
+    std::vector<COutPoint> vErase;
+    for(int i = 0; i < (int)block.vtx.size(); i++){
+        const CTransaction& current_tx = block.vtx[i];
+        for(const CTxIn& current_vin : current_tx.vin){
+            auto it = mPillarCollaterals.find(current_vin.prevout);
+            if(it == mPillarCollaterals.end())
+                continue;
+            if((unsigned int)pindex->nHeight <= PLI_END)
+                MAX_PILLARS_ALLOWED--;
+            vSpent.push_back(std::make_pair(it->first, it->second));
+            vErase.push_back(it->first);
+            DeletePillarUtxo(current_vin.prevout);
+        }
+        for(int j = 0; j < (int)current_tx.vout.size(); j++){
+            if(current_tx.vout[j].nValue != MNP * COIN)
+                continue;
+            if((unsigned int)pindex->nHeight <= PLI_END)
+                MAX_PILLARS_ALLOWED++;
+            COutPoint temp_outpoint(current_tx.GetHash(), j);
+            vAdded.push_back(std::make_pair(temp_outpoint, std::make_pair(pindex->nHeight, i)));
+            AddPillarUtxo(temp_outpoint, std::make_pair(pindex->nHeight, i));
         }
-        left++;
     }
 
-    for(auto& itr: vPillarCollaterals)
-        mPillarCollaterals.insert(std::make_pair(itr.first, itr.second));
-    
-    vPillarCollaterals.clear();
+    if(!vSpent.empty() && !pblocktree->WritePillarUndo(pindex->GetBlockHash(), vSpent))
+        return error("%s: failed to write pillar undo data", __func__);
+    if(!pblocktree->UpdatePillarCollaterals(pindex->GetBlockHash(), MAX_PILLARS_ALLOWED, vAdded, vErase))
+        return error("%s: failed to write pillar utxo index", __func__);
+
+    hashPillarBest = pindex->GetBlockHash();
+    last_block_scanned = pindex->nHeight;
+    return true;
+}
 
-    for(auto& itr: mPillarCollaterals){
-        vPillarCollaterals.push_back(std::make_pair(COutPoint(itr.first), itr.second));
+bool CMasternodeMan::DisconnectPillarBlock(const CBlock& block, const CBlockIndex* pindex){
+    AssertLockHeld(cs_main);
+    LOCK(cs);
+
+    if(!fPillarsLoaded || (unsigned int)pindex->nHeight < PLI_START)
+        return true;
+
+    // put back what the block spent, then remove what it created (which may include some of the former)
+    std::vector<std::pair<COutPoint, std::pair<int, int> > > vSpent;
+    pblocktree->ReadPillarUndo(pindex->GetBlockHash(), vSpent);
+    for(auto& itr: vSpent){
+        if((unsigned int)pindex->nHeight <= PLI_END)
+            MAX_PILLARS_ALLOWED++;
+        AddPillarUtxo(itr.first, itr.second);
+    }
+
+    std::vector<COutPoint> vErase;
+    for(const CTransaction& current_tx: block.vtx){
+        for(int j = 0; j < (int)current_tx.vout.size(); j++){
+            if(current_tx.vout[j].nValue != MNP * COIN)
+                continue;
+            if((unsigned int)pindex->nHeight <= PLI_END)
+                MAX_PILLARS_ALLOWED--;
+            COutPoint temp_outpoint(current_tx.GetHash(), j);
+            vErase.push_back(temp_outpoint);
+            DeletePillarUtxo(temp_outpoint);
+        }
     }
 
     std::sort(vPillarCollaterals.begin(), vPillarCollaterals.end(), less_than_key());
 
+    if(!pblocktree->UpdatePillarCollaterals(pindex->pprev->GetBlockHash(), MAX_PILLARS_ALLOWED, vSpent, vErase))
+        return error("%s: failed to write pillar utxo index", __func__);
+    pblocktree->ErasePillarUndo(pindex->GetBlockHash());
+
+    hashPillarBest = pindex->pprev->GetBlockHash();
+    last_block_scanned = pindex->pprev->nHeight;
     return true;
 }
@@ -53,6 +53,29 @@ class hash_by_outpoint{
         }
 };
 
+/** Salted hasher for the masternode lookup indexes, their keys come from the network */
+class CMasternodeKeyHasher
+{
+private:
+    uint256 salt;
+
+public:
+    CMasternodeKeyHasher();
+
+    size_t operator()(const COutPoint& outpoint) const
+    {
+        return outpoint.hash.GetHash(salt) ^ outpoint.n;
+    }
+    size_t operator()(const CScript& script) const
+    {
+        return Hash(script.begin(), script.end()).GetHash(salt);
+    }
+    size_t operator()(const CPubKey& pubKey) const
+    {
+        return pubKey.GetHash().GetHash(salt);
+    }
+};
+
 class CMasternodeMan
 {
 private:
@@ -64,6 +87,10 @@ private:
 
     // map to hold all MNs and Pillars
     std::vector<CMasternode> vMasternodes;
+    // position in vMasternodes of the first entry with a given collateral, payee and masternode key
+    std::unordered_map<COutPoint, size_t, CMasternodeKeyHasher> mapOutpointIndex;
+    std::unordered_map<CScript, size_t, CMasternodeKeyHasher> mapPayeeIndex;
+    std::unordered_map<CPubKey, size_t, CMasternodeKeyHasher> mapPubKeyIndex;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
@@ -71,6 +98,8 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // the pillar utxo are guarded by cs, blocks change them under cs_main while the
+    // masternode message handlers read them
     // the number of pillar utxo made in the pli stage
     unsigned int MAX_PILLARS_ALLOWED;
     // array for all pillar utxo
@@ -79,8 +108,30 @@ private:
     std::unordered_map<COutPoint, std::pair<int, int>, hash_by_outpoint> mPillarCollaterals;
     // checkpoint for pillar utxo scan
     unsigned int last_block_scanned;
+    // active chain block the pillar utxo index is up to date with
+    uint256 hashPillarBest;
+    bool fPillarsLoaded;
     // hold the last 10 ratios for node voting
     std::vector<double> vLastRatios;
+
+    // scores of all masternodes for one block height
+    struct CMasternodeScores {
+        uint256 hashBlock;
+        // full score of each entry of vMasternodes, by index
+        std::vector<uint256> vScore;
+        // compact score and index of each entry of vMasternodes, highest score first
+        std::vector<std::pair<int64_t, size_t> > vRanked;
+    };
+    // score tables of recently queried heights, cleared whenever vMasternodes changes
+    std::map<int64_t, CMasternodeScores> mapScoreCache;
+    // table handed out for a height whose block is unknown, every score is zero
+    CMasternodeScores scoresUnknownBlock;
+
+    /// Get the scores of all masternodes for a block height, computing them once per height
+    const CMasternodeScores& GetScores(int64_t nBlockHeight);
+
+    /// Add the entry at nIndex of vMasternodes to the lookup indexes
+    void IndexMasternode(size_t nIndex);
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -108,6 +159,10 @@ public:
         READWRITE(MAX_PILLARS_ALLOWED);
         READWRITE(vPillarCollaterals);
         READWRITE(last_block_scanned);
+        if (ser_action.ForRead()) {
+            mapScoreCache.clear();
+            ReindexMasternodes();
+        }
     }
 
     CMasternodeMan();
@@ -139,6 +194,12 @@ public:
     CMasternode* Find(const CTxIn& vin);
     CMasternode* Find(const CPubKey& pubKeyMasternode);
 
+    /// Rebuild the lookup indexes, needed when entries are removed or a key changes in place
+    void ReindexMasternodes();
+
+    /// Update an entry from a newer broadcast, reindexing it when its keys change
+    bool UpdateFromNewBroadcast(CMasternode& mn, CMasternodeBroadcast& mnb);
+
     /// Find an entry in the masternode list that is next to be paid
     CMasternode* GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount);
 
@@ -162,24 +223,23 @@ public:
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
-    void UpdateLastScannedBlock(int nHeight){
-        last_block_scanned = nHeight;
-    }
-
     // return the number of active pillars
     int PillarCount(int protocolVersion = -1);
     
     int PillarSlots(){
+        LOCK(cs);
         return vPillarCollaterals.size() < MAX_PILLARS_ALLOWED ? MAX_PILLARS_ALLOWED - vPillarCollaterals.size() : 0;
     }
     
     int PillarQueueSize(){
+        LOCK(cs);
         return vPillarCollaterals.size() > MAX_PILLARS_ALLOWED ? vPillarCollaterals.size() - MAX_PILLARS_ALLOWED : 0;
     }
 
     std::vector<std::pair<int, std::string> > PillarQueuePositions();
 
     bool IsPillar(const COutPoint& utxo){
+        LOCK(cs);
         return mPillarCollaterals.count(utxo) > 0;
     }
 
@@ -188,15 +248,11 @@ public:
     // bootstrap for pillar utxos
     bool InitPillars();
 
-    void InitRatios();
+    // keep the pillar utxo index in step with the active chain
+    bool ConnectPillarBlock(const CBlock& block, const CBlockIndex* pindex);
+    bool DisconnectPillarBlock(const CBlock& block, const CBlockIndex* pindex);
 
-    void IncrementMaxPillarsAllowed(){
-        MAX_PILLARS_ALLOWED++;
-    }
-
-    void DecrementMaxPillarsAllowed(){
-        MAX_PILLARS_ALLOWED--;
-    }
+    void InitRatios();
 
     void AddPillarUtxo(const COutPoint& first, std::pair<int, int> second);
 
@@ -8,11 +8,14 @@
 #ifndef BITCOIN_MINER_H
 #define BITCOIN_MINER_H
 
+#include "amount.h"
+
 #include <stdint.h>
 
 class CBlock;
 class CBlockHeader;
 class CBlockIndex;
+class CCoinsView;
 class CReserveKey;
 class CScript;
 class CWallet;
@@ -23,6 +26,12 @@ struct CBlockTemplate;
 CBlockIndex* GetChainTip();
 /** Generate a new block, without valid proof-of-work */
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake);
+/**
+ * Add memory pool transactions to a block template at nHeight, spending the coins of pcoins:
+ * the priority area first, then packages by ancestor fee rate. Callers hold cs_main and mempool.cs.
+ */
+void AddMempoolTxsToBlock(CBlockTemplate* pblocktemplate, int nHeight, CCoinsView* pcoins, unsigned int nBlockMaxSize,
+                          unsigned int nBlockPrioritySize, unsigned int nBlockMinSize, uint64_t& nBlockTxRet, uint64_t& nBlockSizeRet, CAmount& nFeesRet);
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 /** Check mined block */
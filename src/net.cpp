@@ -27,6 +27,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -59,12 +63,18 @@
 namespace
 {
 const int MAX_OUTBOUND_CONNECTIONS = 16;
+// longest wait for socket events before the socket handler runs its housekeeping
+const int SOCKET_EVENTS_WAIT_MILLIS = 50;
+// most socket events taken from epoll per wait
+const int MAX_SOCKET_EVENTS = 256;
 
 struct ListenSocket {
     SOCKET socket;
     bool whitelisted;
+    // a connection may be waiting to be accepted
+    bool ready;
 
-    ListenSocket(SOCKET socket, bool whitelisted) : socket(socket), whitelisted(whitelisted) {}
+    ListenSocket(SOCKET socket, bool whitelisted) : socket(socket), whitelisted(whitelisted), ready(false) {}
 };
 }
 
@@ -82,6 +92,17 @@ uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
 CAddrMan addrman;
 int nMaxConnections = 125;
+#ifdef HAVE_SYS_EPOLL_H
+SocketEventsMode nSocketEventsMode = SOCKETEVENTS_EPOLL;
+static int hEpollSocketEvents = -1;
+#else
+SocketEventsMode nSocketEventsMode = SOCKETEVENTS_SELECT;
+#endif
+#ifndef WIN32
+// pipe the socket handler waits on together with the sockets, see WakeupSocketHandler
+static int nWakeupPipe[2] = {-1, -1};
+static std::atomic<bool> fWakeupPending(false);
+#endif
 bool fAddressesInitialized = false;
 std::string strSubVersion;
 
@@ -106,11 +127,80 @@ CCriticalSection cs_nLastNodeId;
 
 static CSemaphore* semOutbound = NULL;
 boost::condition_variable messageHandlerCondition;
+static int nMessageHandlerThreads = 1;
+// lanes with work left by another lane, they skip their next wait
+static boost::mutex messageHandlerMutex;
+static bool fMessageHandlerLaneWoken[MSGLANE_CONCURRENT + 1] = {};
 
 // Signals for message handling
 static CNodeSignals g_signals;
 CNodeSignals& GetNodeSignals() { return g_signals; }
 
+bool IsConcurrentMessage(const std::string& strCommand)
+{
+    return strCommand == "mnb" || strCommand == "mnp" || strCommand == "dseg" ||
+           strCommand == "mnvs" || strCommand == "mprop" || strCommand == "mvote" ||
+           strCommand == "mnget" || strCommand == "mnw";
+}
+
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& modeRet)
+{
+    if (strMode == "select") {
+        modeRet = SOCKETEVENTS_SELECT;
+        return true;
+    }
+#ifdef HAVE_SYS_EPOLL_H
+    if (strMode == "epoll") {
+        modeRet = SOCKETEVENTS_EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string GetSocketEventsModeName(SocketEventsMode mode)
+{
+    switch (mode) {
+    case SOCKETEVENTS_SELECT:
+        return "select";
+    case SOCKETEVENTS_EPOLL:
+        return "epoll";
+    }
+    return "unknown";
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    return "select, epoll";
+#else
+    return "select";
+#endif
+}
+
+void WakeupSocketHandler()
+{
+#ifndef WIN32
+    // one pending byte is enough to end the wait
+    if (nWakeupPipe[1] == -1 || fWakeupPending.exchange(true))
+        return;
+    char c = 0;
+    if (write(nWakeupPipe[1], &c, 1) != 1)
+        fWakeupPending = false;
+#endif
+}
+
+#ifndef WIN32
+static void DrainWakeupPipe()
+{
+    // clear the flag first, a wakeup racing with the drain then writes again
+    fWakeupPending = false;
+    char buf[128];
+    while (read(nWakeupPipe[0], buf, sizeof(buf)) > 0) {
+    }
+}
+#endif
+
 void AddOneShot(std::string strDest)
 {
     LOCK(cs_vOneShots);
@@ -412,7 +502,7 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMa
     bool proxyConnectionFailed = false;
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed)) {
-        if (!IsSelectableSocket(hSocket)) {
+        if (nSocketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -428,6 +518,8 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMa
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
         }
+        // let the socket handler pick up the new socket
+        WakeupSocketHandler();
 
         pnode->nTimeConnected = GetTime();
         if (obfuScationMaster) pnode->fObfuScationMaster = true;
@@ -445,9 +537,13 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMa
 void CNode::CloseSocketDisconnect()
 {
     fDisconnect = true;
-    if (hSocket != INVALID_SOCKET) {
-        LogPrint("net", "disconnecting peer=%d\n", id);
-        CloseSocket(hSocket);
+    {
+        LOCK(cs_hSocket);
+        if (hSocket != INVALID_SOCKET) {
+            LogPrint("net", "disconnecting peer=%d\n", id);
+            UnregisterSocketEvents();
+            CloseSocket(hSocket);
+        }
     }
 
     // in case this fails, we'll empty the recv buffer when the CNode is deleted
@@ -456,6 +552,19 @@ void CNode::CloseSocketDisconnect()
         vRecvMsg.clear();
 }
 
+void CNode::UnregisterSocketEvents()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    // A child started by runCommand() may still hold a copy of the socket, which keeps it
+    // in the epoll set after we close it and would report events for a deleted node.
+    if (fSocketRegistered) {
+        if (epoll_ctl(hEpollSocketEvents, EPOLL_CTL_DEL, hSocket, NULL) != 0)
+            LogPrint("net", "socket epoll_ctl del error %s\n", NetworkErrorString(WSAGetLastError()));
+        fSocketRegistered = false;
+    }
+#endif
+}
+
 bool CNode::DisconnectOldProtocol(int nVersionRequired, std::string strLastCommand)
 {
     fDisconnect = false;
@@ -734,7 +843,7 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            messageHandlerCondition.notify_all();
         }
     }
 
@@ -833,9 +942,178 @@ void SocketSendData(CNode* pnode)
 
 static std::list<CNode*> vNodesDisconnected;
 
+static bool HasDataToSend(CNode* pnode)
+{
+    TRY_LOCK(pnode->cs_vSend, lockSend);
+    return lockSend && !pnode->vSendMsg.empty();
+}
+
+static bool CanReceiveMore(CNode* pnode)
+{
+    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+    return lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                           pnode->GetTotalRecvSize() <= ReceiveFloodSize());
+}
+
+/** Wait for socket events with select(), readiness only holds until the next wait */
+static void SocketEventsSelect()
+{
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = SOCKET_EVENTS_WAIT_MILLIS * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+#ifndef WIN32
+    if (nWakeupPipe[0] != -1) {
+        FD_SET(nWakeupPipe[0], &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, (SOCKET)nWakeupPipe[0]);
+        have_fds = true;
+    }
+#endif
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes) {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is no (complete) message in the receive buffer,
+            //   or there is space left in the buffer, select() for receiving data.
+            // * (if neither of the above applies, there is certainly one message
+            //   in the receiver buffer ready to be processed).
+            // Together, that means that at least one of the following is always possible,
+            // so we don't deadlock:
+            // * We send some data.
+            // * We wait for data to be received (and disconnect after timeout).
+            // * We process a message in the buffer (message handler thread).
+            if (HasDataToSend(pnode)) {
+                FD_SET(pnode->hSocket, &fdsetSend);
+                continue;
+            }
+            if (CanReceiveMore(pnode))
+                FD_SET(pnode->hSocket, &fdsetRecv);
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+        &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
+
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(timeout.tv_usec / 1000);
+    }
+
+#ifndef WIN32
+    if (nWakeupPipe[0] != -1 && FD_ISSET(nWakeupPipe[0], &fdsetRecv))
+        DrainWakeupPipe();
+#endif
+
+    for (ListenSocket& hListenSocket : vhListenSocket)
+        hListenSocket.ready = hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv);
+
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodes) {
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        pnode->fHasRecvData = FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError);
+        pnode->fCanSendData = FD_ISSET(pnode->hSocket, &fdsetSend);
+    }
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/**
+ * Wait for socket events with epoll. Node sockets are edge-triggered, so a node stays
+ * flagged until recv() or send() would block and nodes without events cost nothing here.
+ */
+static void SocketEventsEpoll(int nTimeout)
+{
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes) {
+            LOCK(pnode->cs_hSocket);
+            if (pnode->fSocketRegistered || pnode->hSocket == INVALID_SOCKET)
+                continue;
+            // CloseSocketDisconnect() takes the socket out again before closing it
+            struct epoll_event event;
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.ptr = pnode;
+            if (epoll_ctl(hEpollSocketEvents, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+                LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(WSAGetLastError()));
+                pnode->fDisconnect = true;
+                continue;
+            }
+            pnode->fSocketRegistered = true;
+        }
+    }
+
+    struct epoll_event events[MAX_SOCKET_EVENTS];
+    int nEvents = epoll_wait(hEpollSocketEvents, events, MAX_SOCKET_EVENTS, nTimeout);
+    boost::this_thread::interruption_point();
+
+    if (nEvents < 0) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+            MilliSleep(nTimeout);
+        }
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        if (events[i].data.ptr == NULL) {
+            // listen sockets are level-triggered, accept() tells which one is ready
+            for (ListenSocket& hListenSocket : vhListenSocket)
+                hListenSocket.ready = true;
+        } else if (events[i].data.ptr == nWakeupPipe) {
+            DrainWakeupPipe();
+        } else {
+            // nodes are only deleted by the socket handler after their socket left the epoll set
+            CNode* pnode = (CNode*)events[i].data.ptr;
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+                pnode->fHasRecvData = true;
+            // errors surface on whichever call comes first
+            if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+                pnode->fCanSendData = true;
+        }
+    }
+}
+#endif
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    bool fMoreWork = false;
     while (true) {
         //
         // Disconnect nodes
@@ -901,86 +1179,20 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes) {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
-
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
-        }
+#ifdef HAVE_SYS_EPOLL_H
+        if (nSocketEventsMode == SOCKETEVENTS_EPOLL)
+            SocketEventsEpoll(fMoreWork ? 0 : SOCKET_EVENTS_WAIT_MILLIS);
+        else
+#endif
+            SocketEventsSelect();
+        fMoreWork = false;
 
         //
         // Accept new connections
         //
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+        for (ListenSocket& hListenSocket : vhListenSocket) {
+            if (hListenSocket.socket != INVALID_SOCKET && hListenSocket.ready) {
+                hListenSocket.ready = false;
                 struct sockaddr_storage sockaddr;
                 socklen_t len = sizeof(sockaddr);
                 SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
@@ -1003,9 +1215,12 @@ void ThreadSocketHandler()
                     int nErr = WSAGetLastError();
                     if (nErr != WSAEWOULDBLOCK)
                         LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
-                } else if (!IsSelectableSocket(hSocket)) {
+                } else if (nSocketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket)) {
                     LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
                     CloseSocket(hSocket);
+                } else if (!SetSocketNoInherit(hSocket)) {
+                    LogPrintf("connection from %s dropped: socket would be inherited (%s)\n", addr.ToString(), NetworkErrorString(WSAGetLastError()));
+                    CloseSocket(hSocket);
                 } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
                     LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
                     CloseSocket(hSocket);
@@ -1043,7 +1258,15 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            bool fRecv = pnode->fHasRecvData;
+            bool fSend = pnode->fCanSendData;
+            if (nSocketEventsMode != SOCKETEVENTS_SELECT) {
+                // readiness outlives the wait here, apply the preferences select() is set up with
+                bool fSendPending = HasDataToSend(pnode);
+                fRecv = fRecv && !fSendPending && CanReceiveMore(pnode);
+                fSend = fSend && fSendPending;
+            }
+            if (fRecv) {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv) {
                     {
@@ -1056,6 +1279,9 @@ void ThreadSocketHandler()
                             pnode->nLastRecv = GetTime();
                             pnode->nRecvBytes += nBytes;
                             pnode->RecordBytesRecv(nBytes);
+                            // a short read drained the socket
+                            if (nBytes < (int)sizeof(pchBuf))
+                                pnode->fHasRecvData = false;
                         } else if (nBytes == 0) {
                             // socket closed gracefully
                             if (!pnode->fDisconnect)
@@ -1068,6 +1294,8 @@ void ThreadSocketHandler()
                                 if (!pnode->fDisconnect)
                                     LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
                                 pnode->CloseSocketDisconnect();
+                            } else if (nErr == WSAEWOULDBLOCK) {
+                                pnode->fHasRecvData = false;
                             }
                         }
                     }
@@ -1079,12 +1307,20 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            if (fSend) {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
+                if (lockSend) {
                     SocketSendData(pnode);
+                    // the socket would block, only cleared here so no later edge gets lost
+                    if (!pnode->vSendMsg.empty())
+                        pnode->fCanSendData = false;
+                }
             }
 
+            // with edge-triggered events nothing wakes us for data that is still waiting
+            if ((fRecv && pnode->fHasRecvData) || (fSend && pnode->fCanSendData && HasDataToSend(pnode)))
+                fMoreWork = true;
+
             //
             // Inactivity checking
             //
@@ -1493,11 +1729,17 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant* grantOu
 }
 
 
-void ThreadMessageHandler()
+void WakeupMessageHandler(MessageHandlerLane lane)
 {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
+    {
+        boost::unique_lock<boost::mutex> lock(messageHandlerMutex);
+        fMessageHandlerLaneWoken[lane] = true;
+    }
+    messageHandlerCondition.notify_all();
+}
 
+static void MessageHandlerLoop(MessageHandlerLane lane)
+{
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true) {
         std::vector<CNode*> vNodesCopy;
@@ -1520,16 +1762,27 @@ void ThreadMessageHandler()
             if (pnode->fDisconnect)
                 continue;
 
-            // Receive messages
+            // Receive messages, a node is only processed by one thread at a time which keeps its messages in order
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv) {
-                    if (!g_signals.ProcessMessages(pnode))
+                    if (!g_signals.ProcessMessages(pnode, lane))
                         pnode->CloseSocketDisconnect();
 
+                    // the socket handler left data in the socket while the receive buffer was full
+                    if (nSocketEventsMode != SOCKETEVENTS_SELECT && pnode->fHasRecvData && pnode->GetTotalRecvSize() <= ReceiveFloodSize())
+                        WakeupSocketHandler();
+
                     if (pnode->nSendSize < SendBufferSize()) {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
-                            fSleep = false;
+                        // getdata goes first and is answered on the ordered lane, deferred getdata and messages are woken up again
+                        bool fGetData = !pnode->vRecvGetData.empty();
+                        bool fMessage = !pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete() && !pnode->fMessageDeferred;
+                        if (fGetData ? !pnode->fGetDataDeferred : fMessage) {
+                            bool fConcurrent = !fGetData && IsConcurrentMessage(pnode->vRecvMsg[0].hdr.GetCommand());
+                            if (lane == MSGLANE_ALL || fConcurrent == (lane == MSGLANE_CONCURRENT))
+                                fSleep = false;
+                            else
+                                WakeupMessageHandler(fConcurrent ? MSGLANE_CONCURRENT : MSGLANE_ORDERED);
                         }
                     }
                 }
@@ -1537,7 +1790,7 @@ void ThreadMessageHandler()
             boost::this_thread::interruption_point();
 
             // Send messages
-            {
+            if (lane != MSGLANE_CONCURRENT) {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
                     g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
@@ -1552,11 +1805,23 @@ void ThreadMessageHandler()
                 pnode->Release();
         }
 
-        if (fSleep)
+        boost::unique_lock<boost::mutex> lock(messageHandlerMutex);
+        if (fSleep && !fMessageHandlerLaneWoken[lane])
             messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+        fMessageHandlerLaneWoken[lane] = false;
     }
 }
 
+void ThreadMessageHandler()
+{
+    MessageHandlerLoop(nMessageHandlerThreads > 1 ? MSGLANE_ORDERED : MSGLANE_ALL);
+}
+
+void ThreadConcurrentMessageHandler()
+{
+    MessageHandlerLoop(MSGLANE_CONCURRENT);
+}
+
 bool BindListenPort(const CService& addrBind, std::string& strError, bool fWhitelisted)
 {
     strError = "";
@@ -1582,6 +1847,12 @@ bool BindListenPort(const CService& addrBind, std::string& strError, bool fWhite
         LogPrintf("%s\n", strError);
         return false;
     }
+    if (!SetSocketNoInherit(hListenSocket)) {
+        strError = strprintf("Error: Couldn't keep the socket for incoming connections from being inherited (error %s)", NetworkErrorString(WSAGetLastError()));
+        LogPrintf("%s\n", strError);
+        CloseSocket(hListenSocket);
+        return false;
+    }
 
 
 #ifndef WIN32
@@ -1688,6 +1959,48 @@ void static Discover(boost::thread_group& threadGroup)
 #endif
 }
 
+static void InitSocketEvents()
+{
+#ifndef WIN32
+    if (nWakeupPipe[0] == -1) {
+        if (pipe(nWakeupPipe) != 0) {
+            LogPrintf("Could not create the socket handler wakeup pipe: %s\n", NetworkErrorString(WSAGetLastError()));
+            nWakeupPipe[0] = nWakeupPipe[1] = -1;
+        } else {
+            for (int i = 0; i < 2; i++)
+                fcntl(nWakeupPipe[i], F_SETFL, fcntl(nWakeupPipe[i], F_GETFL, 0) | O_NONBLOCK);
+        }
+    }
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (nSocketEventsMode == SOCKETEVENTS_EPOLL && hEpollSocketEvents == -1) {
+        hEpollSocketEvents = epoll_create1(EPOLL_CLOEXEC);
+        bool fOk = hEpollSocketEvents != -1;
+
+        // listen sockets and the wakeup pipe are level-triggered
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        for (const ListenSocket& hListenSocket : vhListenSocket)
+            fOk = fOk && epoll_ctl(hEpollSocketEvents, EPOLL_CTL_ADD, hListenSocket.socket, &event) == 0;
+        event.data.ptr = nWakeupPipe;
+        if (nWakeupPipe[0] != -1)
+            fOk = fOk && epoll_ctl(hEpollSocketEvents, EPOLL_CTL_ADD, nWakeupPipe[0], &event) == 0;
+
+        if (!fOk) {
+            LogPrintf("Could not set up epoll (%s), falling back to select\n", NetworkErrorString(WSAGetLastError()));
+            if (hEpollSocketEvents != -1)
+                close(hEpollSocketEvents);
+            hEpollSocketEvents = -1;
+            nSocketEventsMode = SOCKETEVENTS_SELECT;
+        }
+    }
+#endif
+
+    LogPrintf("Using %s for socket events\n", GetSocketEventsModeName(nSocketEventsMode));
+}
+
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
 {
     //uiInterface.InitMessage(_("Loading addresses..."));
@@ -1740,6 +2053,9 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Map ports with UPnP
     MapPort(GetBoolArg("-upnp", DEFAULT_UPNP));
 
+    // Set up the socket events mode before the socket handler starts waiting
+    InitSocketEvents();
+
     // Send and receive from sockets, accept connections
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "net", &ThreadSocketHandler));
 
@@ -1749,8 +2065,11 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Initiate outbound connections
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
-    // Process messages
+    // Process messages, blocks and transactions on the first thread and the concurrent messages on the others
+    nMessageHandlerThreads = std::max(1, std::min((int)GetArg("-msghandthreads", DEFAULT_MSGHAND_THREADS), MAX_MSGHAND_THREADS));
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    for (int i = 1; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghandx", &ThreadConcurrentMessageHandler));
 
     // Dump network addresses
     scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
@@ -1788,6 +2107,19 @@ public:
                 if (!CloseSocket(hListenSocket.socket))
                     LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
 
+#ifdef HAVE_SYS_EPOLL_H
+        if (hEpollSocketEvents != -1)
+            close(hEpollSocketEvents);
+        hEpollSocketEvents = -1;
+#endif
+#ifndef WIN32
+        for (int i = 0; i < 2; i++) {
+            if (nWakeupPipe[i] != -1)
+                close(nWakeupPipe[i]);
+            nWakeupPipe[i] = -1;
+        }
+#endif
+
         // clean up some globals (to help leak detection)
         for (CNode* pnode : vNodes)
             delete pnode;
@@ -2053,6 +2385,11 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     fNetworkNode = false;
     fSuccessfullyConnected = false;
     fDisconnect = false;
+    fHasRecvData = false;
+    fCanSendData = false;
+    fSocketRegistered = false;
+    fGetDataDeferred = false;
+    fMessageDeferred = false;
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
@@ -2087,6 +2424,10 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
 
 CNode::~CNode()
 {
+    {
+        LOCK(cs_hSocket);
+        UnregisterSocketEvents();
+    }
     CloseSocket(hSocket);
 
     if (pfilter)
@@ -2178,8 +2519,12 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
     nSendSize += (*it).size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (it == vSendMsg.begin()) {
         SocketSendData(this);
+        // hand the rest to the socket handler right away
+        if (!vSendMsg.empty())
+            WakeupSocketHandler();
+    }
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
@@ -21,6 +21,7 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
 #include <deque>
 #include <stdint.h>
 
@@ -63,6 +64,10 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** Default number of message handler threads, threads past the first process the concurrent messages */
+static const int DEFAULT_MSGHAND_THREADS = 2;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHAND_THREADS = 16;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -83,12 +88,42 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode* pnode);
 
+/** How the socket handler thread waits for sockets to become ready */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT,
+    SOCKETEVENTS_EPOLL,
+};
+
+/** Parse a -socketevents mode, only modes supported by this build are accepted */
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& modeRet);
+std::string GetSocketEventsModeName(SocketEventsMode mode);
+/** Comma separated list of the modes supported by this build */
+std::string GetSupportedSocketEventsModes();
+/** Interrupt the socket handler's wait, e.g. when a node can take more data */
+void WakeupSocketHandler();
+
 typedef int NodeId;
 
+/** Which messages a message handler thread takes from the front of a node's receive queue */
+enum MessageHandlerLane {
+    MSGLANE_ALL,        // the only message handler thread
+    MSGLANE_ORDERED,    // main message handler next to extra ones: all but the concurrent messages
+    MSGLANE_CONCURRENT, // extra message handler threads: only the concurrent messages
+};
+
+/** Wake up the message handler threads of a lane, e.g. when another lane left work for it */
+void WakeupMessageHandler(MessageHandlerLane lane);
+
+/**
+ * Masternode list, budget and masternode payment messages. They may be processed on the extra
+ * message handler threads, next to blocks and transactions on the main one.
+ */
+bool IsConcurrentMessage(const std::string& strCommand);
+
 // Signals for message handling
 struct CNodeSignals {
     boost::signals2::signal<int()> GetHeight;
-    boost::signals2::signal<bool(CNode*)> ProcessMessages;
+    boost::signals2::signal<bool(CNode*, MessageHandlerLane)> ProcessMessages;
     boost::signals2::signal<bool(CNode*, bool)> SendMessages;
     boost::signals2::signal<void(NodeId, const CNode*)> InitializeNode;
     boost::signals2::signal<void(NodeId)> FinalizeNode;
@@ -130,6 +165,7 @@ extern uint64_t nLocalServices;
 extern uint64_t nLocalHostNonce;
 extern CAddrMan addrman;
 extern int nMaxConnections;
+extern SocketEventsMode nSocketEventsMode;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
@@ -296,6 +332,10 @@ public:
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
+    // all of vRecvGetData waits for a masternode message family busy on a concurrent message handler
+    bool fGetDataDeferred;
+    // the concurrent message at the front of vRecvMsg waits for cs_main
+    bool fMessageDeferred;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
     uint64_t nRecvBytes;
@@ -321,6 +361,13 @@ public:
     bool fNetworkNode;
     bool fSuccessfullyConnected;
     bool fDisconnect;
+    // socket readiness reported to the socket handler, with epoll it is kept until recv/send would block
+    std::atomic<bool> fHasRecvData;
+    std::atomic<bool> fCanSendData;
+    // socket is registered with the socket handler's epoll instance, guarded by cs_hSocket
+    bool fSocketRegistered;
+    // held while the socket is registered with or closed to the socket handler
+    CCriticalSection cs_hSocket;
     // We use fRelayTxes for two purposes -
     // a) it allows us to not relay tx invs before receiving the peer's version message
     // b) the peer may tell us in their version message that we should not relay tx invs
@@ -687,6 +734,8 @@ public:
     void Subscribe(unsigned int nChannel, unsigned int nHops = 0);
     void CancelSubscribe(unsigned int nChannel);
     void CloseSocketDisconnect();
+    /** Take the socket out of the socket handler's epoll set, callers hold cs_hSocket */
+    void UnregisterSocketEvents();
     bool DisconnectOldProtocol(int nVersionRequired, std::string strLastCommand = "");
 
     // Denial-of-service detection/prevention
@@ -65,6 +65,8 @@
 class CSporkMessage;
 class CSporkManager;
 
+// guards mapSporks and mapSporksActive, nothing else is locked while it is held
+extern CCriticalSection cs_mapSporks;
 extern std::map<uint256, CSporkMessage> mapSporks;
 extern std::map<int, CSporkMessage> mapSporksActive;
 extern CSporkManager sporkManager;
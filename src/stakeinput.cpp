@@ -175,6 +175,20 @@ bool CZnnStake::SetInput(CTransaction txPrev, unsigned int n)
 {
     this->txFrom = txPrev;
     this->nPosition = n;
+    // drop what was cached for a previous input
+    this->pindexFrom = nullptr;
+    this->nStakeModifier = 0;
+    this->nStakeModifierHeight = 0;
+    this->nStakeModifierTime = 0;
+    this->ssUniqueness.clear();
+    return true;
+}
+
+//Set the input along with the block it was added to, when the caller already knows it
+bool CZnnStake::SetInput(const CTransaction& txPrev, unsigned int n, CBlockIndex* pindexFrom)
+{
+    SetInput(txPrev, n);
+    this->pindexFrom = pindexFrom;
     return true;
 }
 
@@ -243,9 +257,9 @@ bool CZnnStake::GetModifier(uint64_t& nStakeModifier)
 CDataStream CZnnStake::GetUniqueness()
 {
     //The unique identifier for a ZNN stake is the outpoint
-    CDataStream ss(SER_NETWORK, 0);
-    ss << nPosition << txFrom.GetHash();
-    return ss;
+    if (ssUniqueness.empty())
+        ssUniqueness << nPosition << txFrom.GetHash();
+    return ssUniqueness;
 }
 
 //The block that the UTXO was added to the chain
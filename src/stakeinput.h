@@ -83,10 +83,12 @@ private:
     uint64_t nStakeModifier = 0;
     int nStakeModifierHeight = 0;
     int64_t nStakeModifierTime = 0;
+    CDataStream ssUniqueness{SER_NETWORK, 0};
 public:
     CZnnStake(){}
 
     bool SetInput(CTransaction txPrev, unsigned int n);
+    bool SetInput(const CTransaction& txPrev, unsigned int n, CBlockIndex* pindexFrom);
 
     CBlockIndex* GetIndexFrom() override;
     bool GetTxFrom(CTransaction& tx) override;
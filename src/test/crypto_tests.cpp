@@ -132,6 +132,27 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d_batch) {
+    // Lengths around the padding boundaries, and counts around the lane widths
+    const size_t lens[] = {0, 1, 32, 52, 55, 56, 63, 64, 76, 80, 119, 120, 200};
+    const size_t counts[] = {1, 3, 4, 5, 8, 9, 17};
+    for (size_t len : lens) {
+        for (size_t count : counts) {
+            std::vector<unsigned char> in(len * count);
+            for (size_t i = 0; i < in.size(); i++)
+                in[i] = insecure_rand();
+            std::vector<unsigned char> out(32 * count);
+            SHA256DBatch(out.data(), in.data(), len, count);
+            for (size_t i = 0; i < count; i++) {
+                unsigned char hash[32];
+                CSHA256().Write(in.data() + len * i, len).Finalize(hash);
+                CSHA256().Write(hash, 32).Finalize(hash);
+                BOOST_CHECK(std::equal(hash, hash + 32, out.begin() + 32 * i));
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -99,4 +99,179 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 10000LL, 0, 10.0, 1));
+
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 5000LL, 0, 10.0, 1));
+
+    pool.TrimToSize(pool.DynamicMemoryUsage()); // should do nothing
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(pool.exists(tx2.GetHash()));
+
+    pool.TrimToSize(pool.DynamicMemoryUsage() * 3 / 4); // should remove the lower-feerate transaction
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(!pool.exists(tx2.GetHash()));
+
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 5000LL, 0, 10.0, 1));
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vin.resize(1);
+    tx3.vin[0].prevout = COutPoint(tx2.GetHash(), 0);
+    tx3.vin[0].scriptSig = CScript() << OP_2 << OP_3;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_3 << OP_EQUAL;
+    tx3.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 20000LL, 0, 10.0, 1));
+
+    pool.TrimToSize(pool.DynamicMemoryUsage() * 3 / 4); // tx3 should pay for tx2 (CPFP)
+    BOOST_CHECK(!pool.exists(tx1.GetHash()));
+    BOOST_CHECK(pool.exists(tx2.GetHash()));
+    BOOST_CHECK(pool.exists(tx3.GetHash()));
+
+    SetMockTime(42);
+    pool.TrimToSize(1); // nothing fits, the package of tx2 and tx3 goes together
+    BOOST_CHECK(!pool.exists(tx2.GetHash()));
+    BOOST_CHECK(!pool.exists(tx3.GetHash()));
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0);
+
+    CFeeRate maxFeeRateRemoved(25000, ::GetSerializeSize(CTransaction(tx2), SER_NETWORK, PROTOCOL_VERSION) + ::GetSerializeSize(CTransaction(tx3), SER_NETWORK, PROTOCOL_VERSION));
+    CAmount nMinFee = maxFeeRateRemoved.GetFeePerK() + 1000;
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), nMinFee);
+
+    // the minimum fee holds until a block comes in ...
+    SetMockTime(42 + CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), nMinFee);
+    std::vector<CTransaction> vtx;
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 1, conflicts);
+
+    // ... then halves every halflife
+    SetMockTime(42 + 2 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), nMinFee / 2);
+
+    // ... or every quarter of it while the pool is below a quarter of its limit
+    SetMockTime(42 + 2 * CTxMemPool::ROLLING_FEE_HALFLIFE + CTxMemPool::ROLLING_FEE_HALFLIFE / 2);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1000000).GetFeePerK(), nMinFee / 8);
+
+    // ... until it drops below half the relay fee and is cleared
+    SetMockTime(42 + 20 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), 0);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorDescendantTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // A chain A <- B <- C and an unrelated D, all of the same size
+    CMutableTransaction txA, txB, txC, txD;
+    CMutableTransaction* chain[] = {&txA, &txB, &txC, &txD};
+    for (int i = 0; i < 4; i++) {
+        chain[i]->vin.resize(1);
+        chain[i]->vin[0].scriptSig = CScript() << OP_11;
+        chain[i]->vout.resize(1);
+        chain[i]->vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        chain[i]->vout[0].nValue = (10 - i) * COIN;
+    }
+    txB.vin[0].prevout = COutPoint(txA.GetHash(), 0);
+    txC.vin[0].prevout = COutPoint(txB.GetHash(), 0);
+    txD.vin[0].prevout = COutPoint(uint256(1), 0);
+
+    pool.addUnchecked(txA.GetHash(), CTxMemPoolEntry(txA, 10000LL, 3, 10.0, 1));
+    pool.addUnchecked(txB.GetHash(), CTxMemPoolEntry(txB, 20000LL, 2, 10.0, 1));
+    pool.addUnchecked(txC.GetHash(), CTxMemPoolEntry(txC, 1000LL, 1, 10.0, 1));
+    pool.addUnchecked(txD.GetHash(), CTxMemPoolEntry(txD, 5000LL, 4, 10.0, 1));
+    size_t nSize = pool.mapTx.find(txA.GetHash())->GetTxSize();
+
+    CTxMemPool::txiter itA = pool.mapTx.find(txA.GetHash());
+    BOOST_CHECK_EQUAL(itA->GetCountWithDescendants(), 3);
+    BOOST_CHECK_EQUAL(itA->GetSizeWithDescendants(), 3 * nSize);
+    BOOST_CHECK_EQUAL(itA->GetModFeesWithDescendants(), 31000);
+    CTxMemPool::txiter itC = pool.mapTx.find(txC.GetHash());
+    BOOST_CHECK_EQUAL(itC->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(itC->GetSizeWithAncestors(), 3 * nSize);
+    BOOST_CHECK_EQUAL(itC->GetModFeesWithAncestors(), 31000);
+
+    // descendant score, lowest first: C (1000), D (5000), A (31000 / 3), B (20000)
+    std::vector<uint256> sortedOrder;
+    sortedOrder.push_back(txC.GetHash());
+    sortedOrder.push_back(txD.GetHash());
+    sortedOrder.push_back(txA.GetHash());
+    sortedOrder.push_back(txB.GetHash());
+    int i = 0;
+    for (const CTxMemPoolEntry& e : pool.mapTx.get<descendant_score>())
+        BOOST_CHECK_EQUAL(e.GetTx().GetHash().ToString(), sortedOrder[i++].ToString());
+
+    // ancestor score, highest first: B (30000 / 2), C (31000 / 3), A (10000), D (5000)
+    sortedOrder[0] = txB.GetHash();
+    sortedOrder[1] = txC.GetHash();
+    sortedOrder[2] = txA.GetHash();
+    sortedOrder[3] = txD.GetHash();
+    i = 0;
+    for (const CTxMemPoolEntry& e : pool.mapTx.get<ancestor_score>())
+        BOOST_CHECK_EQUAL(e.GetTx().GetHash().ToString(), sortedOrder[i++].ToString());
+
+    // entry time, oldest first
+    sortedOrder[0] = txC.GetHash();
+    sortedOrder[1] = txB.GetHash();
+    sortedOrder[2] = txA.GetHash();
+    sortedOrder[3] = txD.GetHash();
+    i = 0;
+    for (const CTxMemPoolEntry& e : pool.mapTx.get<entry_time>())
+        BOOST_CHECK_EQUAL(e.GetTx().GetHash().ToString(), sortedOrder[i++].ToString());
+
+    // a fee delta on C shows up in the packages of its ancestors
+    pool.PrioritiseTransaction(txC.GetHash(), txC.GetHash().ToString(), 0.0, 20000LL);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txA.GetHash())->GetModFeesWithDescendants(), 51000);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txB.GetHash())->GetModFeesWithDescendants(), 41000);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txC.GetHash())->GetModFeesWithAncestors(), 51000);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txC.GetHash())->GetModifiedFee(), 21000);
+
+    // confirming A leaves B and C without it as an ancestor
+    std::vector<CTransaction> vtx;
+    vtx.push_back(txA);
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 1, conflicts);
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txB.GetHash())->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txC.GetHash())->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txC.GetHash())->GetModFeesWithAncestors(), 41000);
+
+    // disconnecting the block brings A back in front of its in-pool children
+    pool.addUnchecked(txA.GetHash(), CTxMemPoolEntry(txA, 10000LL, 5, 10.0, 1));
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txA.GetHash())->GetCountWithDescendants(), 1);
+    pool.UpdateTransactionsFromBlock(std::vector<uint256>(1, txA.GetHash()));
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txA.GetHash())->GetCountWithDescendants(), 3);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txA.GetHash())->GetModFeesWithDescendants(), 51000);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txC.GetHash())->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txC.GetHash())->GetSizeWithAncestors(), 3 * nSize);
+
+    // expiring B by entry time takes its descendant C along
+    BOOST_CHECK_EQUAL(pool.Expire(1), 0);
+    BOOST_CHECK_EQUAL(pool.Expire(3), 2);
+    BOOST_CHECK(pool.exists(txA.GetHash()));
+    BOOST_CHECK(!pool.exists(txC.GetHash()));
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txA.GetHash())->GetCountWithDescendants(), 1);
+    BOOST_CHECK_EQUAL(pool.Expire(6), 2);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    pool.ClearPrioritisation(txC.GetHash()); // deltas outlive the entries
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
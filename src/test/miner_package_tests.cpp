@@ -0,0 +1,172 @@
+// Copyright (c) 2018-2019 The Zenon developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "main.h"
+#include "miner.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include "test/test_Zenon.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(miner_package_tests, TestingSetup)
+
+static const unsigned int nTestBlockMaxSize = 100000;
+
+// A confirmed output of nValue anyone can spend, in its own transaction
+static uint256 AddCoin(CCoinsViewCache& view, CAmount nValue)
+{
+    static unsigned int nLockTime = 0;
+    CMutableTransaction tx;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.nLockTime = ++nLockTime;
+    *view.ModifyCoins(tx.GetHash()) = CCoins(tx, 1);
+    return tx.GetHash();
+}
+
+// Spend output n of hashPrev into nOutputs outputs of nValueOut each, anyone can spend them
+static CTransaction Spend(const uint256& hashPrev, unsigned int n, CAmount nValueOut, unsigned int nOutputs = 1)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, n);
+    tx.vout.resize(nOutputs);
+    for (CTxOut& out : tx.vout) {
+        out.nValue = nValueOut;
+        out.scriptPubKey = CScript() << OP_TRUE;
+    }
+    return tx;
+}
+
+static void AddToMempool(const CTransaction& tx, CAmount nFee, double dPriority, int nHeight)
+{
+    mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, nFee, GetTime(), dPriority, nHeight));
+}
+
+static std::vector<uint256> AssembleBlock(CCoinsViewCache& view, int nHeight, unsigned int nBlockPrioritySize, unsigned int nBlockMinSize)
+{
+    CBlockTemplate blocktemplate;
+    uint64_t nBlockTx = 0;
+    uint64_t nBlockSize = 0;
+    CAmount nFees = 0;
+    {
+        LOCK2(cs_main, mempool.cs);
+        AddMempoolTxsToBlock(&blocktemplate, nHeight, &view, nTestBlockMaxSize, nBlockPrioritySize, nBlockMinSize, nBlockTx, nBlockSize, nFees);
+    }
+    BOOST_CHECK_EQUAL(nBlockTx, blocktemplate.block.vtx.size());
+
+    std::vector<uint256> vHashes;
+    for (const CTransaction& tx : blocktemplate.block.vtx)
+        vHashes.push_back(tx.GetHash());
+    return vHashes;
+}
+
+BOOST_AUTO_TEST_CASE(child_pays_for_parent)
+{
+    CCoinsViewCache view(pcoinsTip);
+    int nHeight = chainActive.Height() + 1;
+
+    // a parent paying nothing, its child paying enough for both, and an unrelated transaction
+    // paying a fee rate between that of the parent and that of the package
+    CTransaction txParent = Spend(AddCoin(view, COIN), 0, COIN);
+    CTransaction txChild = Spend(txParent.GetHash(), 0, COIN - 1000000);
+    CTransaction txOther = Spend(AddCoin(view, COIN), 0, COIN - 200000);
+    AddToMempool(txParent, 0, 0, nHeight);
+    AddToMempool(txChild, 1000000, 0, nHeight);
+    AddToMempool(txOther, 200000, 0, nHeight);
+
+    std::vector<uint256> vHashes = AssembleBlock(view, nHeight, 0, 0);
+    BOOST_CHECK_EQUAL(vHashes.size(), 3);
+    BOOST_CHECK(vHashes[0] == txParent.GetHash());
+    BOOST_CHECK(vHashes[1] == txChild.GetHash());
+    BOOST_CHECK(vHashes[2] == txOther.GetHash());
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(modified_entry_rescoring)
+{
+    CCoinsViewCache view(pcoinsTip);
+    int nHeight = chainActive.Height() + 1;
+
+    // a free parent with two children: the first one pulls it into the block, after which the
+    // second one, on its own, pays a better fee rate than the unrelated transaction. Together
+    // with the parent it would pay less.
+    CTransaction txParent = Spend(AddCoin(view, COIN), 0, COIN / 2, 2);
+    CTransaction txChild1 = Spend(txParent.GetHash(), 0, COIN / 2 - 1000000);
+    CTransaction txChild2 = Spend(txParent.GetHash(), 1, COIN / 2 - 300000);
+    CTransaction txOther = Spend(AddCoin(view, COIN), 0, COIN - 200000);
+    AddToMempool(txParent, 0, 0, nHeight);
+    AddToMempool(txChild1, 1000000, 0, nHeight);
+    AddToMempool(txChild2, 300000, 0, nHeight);
+    AddToMempool(txOther, 200000, 0, nHeight);
+
+    std::vector<uint256> vHashes = AssembleBlock(view, nHeight, 0, 0);
+    BOOST_CHECK_EQUAL(vHashes.size(), 4);
+    BOOST_CHECK(vHashes[0] == txParent.GetHash());
+    BOOST_CHECK(vHashes[1] == txChild1.GetHash());
+    BOOST_CHECK(vHashes[2] == txChild2.GetHash());
+    BOOST_CHECK(vHashes[3] == txOther.GetHash());
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(priority_area)
+{
+    CCoinsViewCache view(pcoinsTip);
+    int nHeight = chainActive.Height() + 1;
+
+    // an old free transaction and a new one paying a fee
+    CTransaction txFree = Spend(AddCoin(view, COIN), 0, COIN);
+    CTransaction txPaying = Spend(AddCoin(view, COIN), 0, COIN - 200000);
+    AddToMempool(txFree, 0, AllowFreeThreshold() * 10, nHeight);
+    AddToMempool(txPaying, 200000, 0, nHeight);
+
+    // the priority area takes the free transaction first
+    std::vector<uint256> vHashes = AssembleBlock(view, nHeight, 50000, 0);
+    BOOST_CHECK_EQUAL(vHashes.size(), 2);
+    BOOST_CHECK(vHashes[0] == txFree.GetHash());
+    BOOST_CHECK(vHashes[1] == txPaying.GetHash());
+
+    // without it only the paying one goes in
+    vHashes = AssembleBlock(view, nHeight, 0, 0);
+    BOOST_CHECK_EQUAL(vHashes.size(), 1);
+    BOOST_CHECK(vHashes[0] == txPaying.GetHash());
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(free_package_cutoff)
+{
+    CCoinsViewCache view(pcoinsTip);
+    int nHeight = chainActive.Height() + 1;
+
+    // a free package, parent and child, next to a paying transaction
+    CTransaction txParent = Spend(AddCoin(view, COIN), 0, COIN);
+    CTransaction txChild = Spend(txParent.GetHash(), 0, COIN);
+    CTransaction txPaying = Spend(AddCoin(view, COIN), 0, COIN - 200000);
+    AddToMempool(txParent, 0, 0, nHeight);
+    AddToMempool(txChild, 0, 0, nHeight);
+    AddToMempool(txPaying, 200000, 0, nHeight);
+
+    // past the minimum block size free packages are left out
+    std::vector<uint256> vHashes = AssembleBlock(view, nHeight, 0, 0);
+    BOOST_CHECK_EQUAL(vHashes.size(), 1);
+    BOOST_CHECK(vHashes[0] == txPaying.GetHash());
+
+    // below it they fill the block, after the paying one
+    vHashes = AssembleBlock(view, nHeight, 0, nTestBlockMaxSize);
+    BOOST_CHECK_EQUAL(vHashes.size(), 3);
+    BOOST_CHECK(vHashes[0] == txPaying.GetHash());
+    BOOST_CHECK(vHashes[1] == txParent.GetHash());
+    BOOST_CHECK(vHashes[2] == txChild.GetHash());
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
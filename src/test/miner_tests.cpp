@@ -258,6 +258,44 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3);
     delete pblocktemplate;
 
+    // child pays for parent: a cheap parent goes in ahead of a better paying
+    // unrelated transaction when its child pays enough for both
+    mempool.clear();
+    mapArgs["-blockprioritysize"] = "0";
+    CMutableTransaction txParent, txChild, txOther;
+    txParent.vin.resize(1);
+    txParent.vin[0].prevout.hash = txFirst[0]->GetHash();
+    txParent.vin[0].prevout.n = 0;
+    txParent.vin[0].scriptSig = CScript() << OP_1;
+    txParent.vout.resize(1);
+    txParent.vout[0].nValue = 4900000000LL;
+    txParent.vout[0].scriptPubKey = CScript() << OP_1;
+    mempool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 100, GetTime(), 111.0, 11));
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vin[0].scriptSig = CScript() << OP_1;
+    txChild.vout.resize(1);
+    txChild.vout[0].nValue = 4800000000LL;
+    txChild.vout[0].scriptPubKey = CScript() << OP_1;
+    mempool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 100000000LL, GetTime(), 111.0, 11));
+    txOther.vin.resize(1);
+    txOther.vin[0].prevout.hash = txFirst[1]->GetHash();
+    txOther.vin[0].prevout.n = 0;
+    txOther.vin[0].scriptSig = CScript() << OP_1;
+    txOther.vout.resize(1);
+    txOther.vout[0].nValue = 4800000000LL;
+    txOther.vout[0].scriptPubKey = CScript() << OP_1;
+    mempool.addUnchecked(txOther.GetHash(), CTxMemPoolEntry(txOther, 10000000LL, GetTime(), 111.0, 11));
+
+    BOOST_CHECK(pblocktemplate = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == txParent.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2].GetHash() == txChild.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[3].GetHash() == txOther.GetHash());
+    delete pblocktemplate;
+    mapArgs.erase("-blockprioritysize");
+
     chainActive.Tip()->nHeight--;
     SetMockTime(0);
     mempool.clear();
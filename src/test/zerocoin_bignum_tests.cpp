@@ -87,4 +87,65 @@ BOOST_AUTO_TEST_CASE(bignum_random_generation_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(bignum_fixed_base_pow_tests)
+{
+    CBigNum bnModulus;
+    bnModulus.SetDec(zerocoinModulus);
+    libzerocoin::ZerocoinParams params(bnModulus);
+
+    std::vector<const libzerocoin::IntegerGroupParams*> vGroups = {&params.coinCommitmentGroup,
+                                                                   &params.serialNumberSoKCommitmentGroup,
+                                                                   &params.accumulatorParams.accumulatorPoKCommitmentGroup};
+    for (const libzerocoin::IntegerGroupParams* group : vGroups) {
+        std::vector<CBigNum> vExponents = {CBigNum(0), CBigNum(1), CBigNum(15), CBigNum(16), group->groupOrder - 1, group->groupOrder};
+        for (int i = 0; i < 20; i++) {
+            CBigNum e = CBigNum::randBignum(group->groupOrder);
+            vExponents.push_back(e);
+            vExponents.push_back(CBigNum(0) - e);
+            vExponents.push_back(e * group->modulus);
+        }
+        for (const CBigNum& e : vExponents) {
+            BOOST_CHECK_MESSAGE(group->pow_g(e) == group->g.pow_mod(e, group->modulus), strprintf("pow_g mismatch for e=%s", e.GetHex()));
+            BOOST_CHECK_MESSAGE(group->pow_h(e) == group->h.pow_mod(e, group->modulus), strprintf("pow_h mismatch for e=%s", e.GetHex()));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bignum_multi_pow_mod_tests)
+{
+    CBigNum bnModulus;
+    bnModulus.SetDec(zerocoinModulus);
+    libzerocoin::ZerocoinParams params(bnModulus);
+    const CBigNum& g_n = params.accumulatorParams.accumulatorQRNCommitmentGroup.g;
+    const CBigNum& h_n = params.accumulatorParams.accumulatorQRNCommitmentGroup.h;
+
+    // No bases, and zero exponents, give one
+    BOOST_CHECK(CBigNum::multi_pow_mod({}, {}, bnModulus) == 1);
+    BOOST_CHECK(CBigNum::multi_pow_mod({g_n, h_n}, {0, 0}, bnModulus) == 1);
+    BOOST_CHECK_THROW(CBigNum::multi_pow_mod({g_n, h_n}, {1}, bnModulus), bignum_error);
+
+    for (int i = 0; i < 20; i++) {
+        std::vector<CBigNum> vBases = {g_n, h_n, CBigNum::randBignum(bnModulus)};
+        std::vector<CBigNum> vExps;
+        CBigNum bnExpected = 1;
+        for (unsigned int j = 0; j < vBases.size(); j++) {
+            CBigNum e = CBigNum::randBignum(CBigNum(2).pow(i % 2 ? 256 : 2600));
+            // only the quadratic residues are known to be invertible
+            if (j < 2 && (i + j) % 3 == 0)
+                e = CBigNum(0) - e;
+            vExps.push_back(e);
+            bnExpected = bnExpected.mul_mod(vBases[j].pow_mod(e, bnModulus), bnModulus);
+            BOOST_CHECK(CBigNum::multi_pow_mod({vBases[j]}, {e}, bnModulus) == vBases[j].pow_mod(e, bnModulus));
+        }
+        BOOST_CHECK(CBigNum::multi_pow_mod(vBases, vExps, bnModulus) == bnExpected);
+    }
+
+    // Even modulus, and bases larger than the modulus
+    CBigNum bnEven = bnModulus + 1;
+    std::vector<CBigNum> vBases = {bnModulus * 3 + g_n, h_n};
+    std::vector<CBigNum> vExps = {CBigNum::randBignum(bnModulus), CBigNum::randBignum(bnModulus)};
+    BOOST_CHECK(CBigNum::multi_pow_mod(vBases, vExps, bnEven) == vBases[0].pow_mod(vExps[0], bnEven).mul_mod(vBases[1].pow_mod(vExps[1], bnEven), bnEven));
+    BOOST_CHECK(CBigNum::multi_pow_mod(vBases, vExps, bnModulus) == vBases[0].pow_mod(vExps[0], bnModulus).mul_mod(vBases[1].pow_mod(vExps[1], bnModulus), bnModulus));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -519,4 +519,39 @@ BOOST_AUTO_TEST_CASE(zerocoin_spend_test99)
     nValueTarget += OneCoinAmount;
 }
 
+BOOST_AUTO_TEST_CASE(block_index_zerocoin_fields_test)
+{
+    std::cout << "Running block_index_zerocoin_fields_test...\n";
+
+    // the block index used to keep the supply in a map and the mints in a vector
+    std::map<libzerocoin::CoinDenomination, int64_t> mapSupply;
+    std::vector<libzerocoin::CoinDenomination> vMints;
+    CDiskBlockIndex index;
+    for (unsigned int i = 0; i < libzerocoin::zerocoinDenomList.size(); i++) {
+        libzerocoin::CoinDenomination denom = libzerocoin::zerocoinDenomList[i];
+        BOOST_CHECK(libzerocoin::ZerocoinDenominationToIndex(denom) == (int)i);
+        mapSupply[denom] = 1000 * i + 7;
+        index.AddZcMints(denom, 1000 * i + 7);
+    }
+    for (auto denom : {libzerocoin::ZQ_ONE, libzerocoin::ZQ_ONE, libzerocoin::ZQ_FIFTY, libzerocoin::ZQ_FIVE_THOUSAND}) {
+        vMints.push_back(denom);
+        index.AddMintInBlock(denom);
+    }
+    BOOST_CHECK(index.GetMintsInBlock(libzerocoin::ZQ_ONE) == 2);
+    BOOST_CHECK(index.MintedDenomination(libzerocoin::ZQ_FIFTY));
+    BOOST_CHECK(!index.MintedDenomination(libzerocoin::ZQ_TEN));
+    BOOST_CHECK_THROW(index.GetZcMints(libzerocoin::ZQ_ERROR), std::out_of_range);
+
+    CDataStream ssOld(SER_DISK, CLIENT_VERSION), ssNew(SER_DISK, CLIENT_VERSION);
+    ssOld << mapSupply << vMints;
+    index.SerializeZerocoinFields(ssNew, CSerActionSerialize(), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(ssOld.str() == ssNew.str());
+
+    CDiskBlockIndex indexRead;
+    indexRead.SerializeZerocoinFields(ssOld, CSerActionUnserialize(), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(ssOld.empty());
+    BOOST_CHECK(indexRead.nZerocoinSupply == index.nZerocoinSupply);
+    BOOST_CHECK(indexRead.nMintsInBlock == index.nMintsInBlock);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
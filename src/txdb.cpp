@@ -14,6 +14,7 @@
 
 #include <stdint.h>
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 
@@ -209,16 +210,38 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+bool CBlockTreeDB::UpdatePillarCollaterals(const uint256& hashBest, unsigned int nMaxPillars,
+                                           const std::vector<std::pair<COutPoint, std::pair<int, int> > >& vWrite,
+                                           const std::vector<COutPoint>& vErase)
 {
+    // Erase after writing, a collateral created and spent in the same block must end up erased
+    CLevelDBBatch batch;
+    for (const auto& collateral : vWrite)
+        batch.Write(std::make_pair('p', collateral.first), collateral.second);
+    for (const COutPoint& outpoint : vErase)
+        batch.Erase(std::make_pair('p', outpoint));
+    batch.Write('q', std::make_pair(hashBest, nMaxPillars));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::LoadPillarCollaterals(uint256& hashBest, unsigned int& nMaxPillars, std::vector<std::pair<COutPoint, std::pair<int, int> > >& vCollaterals)
+{
+    std::pair<uint256, unsigned int> state;
+    if (!Read('q', state)) {
+        // never built
+        hashBest = 0;
+        nMaxPillars = 0;
+        return true;
+    }
+    hashBest = state.first;
+    nMaxPillars = state.second;
+
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
 
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-    ssKeySet << std::make_pair('b', uint256(0));
+    ssKeySet << 'p';
     pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
-    uint256 nPreviousCheckpoint;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -226,67 +249,186 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
-            if (chType == 'b') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-                pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
-                pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                if (!Params().IsStakeModifierV2(pindexNew->nHeight)) {
-                    pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                } else {
-                    pindexNew->nStakeModifierV2 = diskindex.nStakeModifierV2;
-                }
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+            if (chType != 'p')
+                break;
+            COutPoint outpoint;
+            ssKey >> outpoint;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            std::pair<int, int> position;
+            ssValue >> position;
+            vCollaterals.push_back(std::make_pair(outpoint, position));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
 
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
+    return true;
+}
 
-                //populate accumulator checksum map in memory
-                if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
-                    //Don't load any checkpoints that exist before v2 zznn. The accumulator is invalid for v1 and not used.
-                    if (pindexNew->nHeight >= Params().Zerocoin_Block_V2_Start())
-                        LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
+bool CBlockTreeDB::WipePillarCollaterals()
+{
+    uint256 hashBest;
+    unsigned int nMaxPillars;
+    std::vector<std::pair<COutPoint, std::pair<int, int> > > vCollaterals;
+    if (!LoadPillarCollaterals(hashBest, nMaxPillars, vCollaterals))
+        return false;
 
-                    nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
-                }
+    CLevelDBBatch batch;
+    for (const auto& collateral : vCollaterals)
+        batch.Erase(std::make_pair('p', collateral.first));
+    batch.Erase('q');
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WritePillarUndo(const uint256& hashBlock, const std::vector<std::pair<COutPoint, std::pair<int, int> > >& vSpent)
+{
+    return Write(std::make_pair('P', hashBlock), vSpent);
+}
 
+bool CBlockTreeDB::ReadPillarUndo(const uint256& hashBlock, std::vector<std::pair<COutPoint, std::pair<int, int> > >& vSpent)
+{
+    return Read(std::make_pair('P', hashBlock), vSpent);
+}
+
+bool CBlockTreeDB::ErasePillarUndo(const uint256& hashBlock)
+{
+    return Erase(std::make_pair('P', hashBlock));
+}
+
+namespace
+{
+/** Number of block index entries read from the database and decoded together while loading. */
+const size_t BLOCK_INDEX_LOAD_BATCH = 16384;
+
+struct CBlockIndexLoadEntry {
+    uint256 hash;
+    std::string strValue;
+    CDiskBlockIndex diskindex;
+    std::string strError;
+};
+
+/** Decode every nStep'th entry starting at nStart and check it against the hash it is stored under. */
+void DecodeBlockIndexEntries(std::vector<CBlockIndexLoadEntry>& vEntries, size_t nStart, size_t nStep)
+{
+    for (size_t i = nStart; i < vEntries.size(); i += nStep) {
+        CBlockIndexLoadEntry& entry = vEntries[i];
+        try {
+            CDataStream ssValue(entry.strValue.data(), entry.strValue.data() + entry.strValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> entry.diskindex;
+        } catch (std::exception& e) {
+            entry.strError = strprintf("Deserialize or I/O error - %s", e.what());
+            continue;
+        }
+        entry.diskindex.phashBlock = &entry.hash;
+
+        // the key is the block hash, recomputing it only detects a corrupted entry
+        if (entry.diskindex.GetBlockHash() != entry.hash)
+            entry.strError = strprintf("block hash does not match its key: %s", entry.diskindex.ToString());
+        else if (entry.diskindex.nHeight <= Params().LAST_POW_BLOCK() && !CheckProofOfWork(entry.hash, entry.diskindex.nBits))
+            entry.strError = strprintf("CheckProofOfWork failed: %s", entry.diskindex.ToString());
+    }
+}
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << std::make_pair('b', uint256(0));
+    pcursor->Seek(ssKeySet.str());
+
+    // Entries are read in batches, decoded and hashed on all verification threads,
+    // and then linked into mapBlockIndex in key order on this one
+    const size_t nThreads = std::max(1, nScriptCheckThreads);
+    std::vector<CBlockIndexLoadEntry> vEntries;
+
+    // Load mapBlockIndex
+    uint256 nPreviousCheckpoint;
+    bool fDone = false;
+    while (!fDone) {
+        boost::this_thread::interruption_point();
+        vEntries.clear();
+        try {
+            while (vEntries.size() < BLOCK_INDEX_LOAD_BATCH) {
+                if (!pcursor->Valid()) {
+                    fDone = true;
+                    break;
+                }
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType;
+                if (chType != 'b') {
+                    fDone = true;
+                    break; // finished loading block index
+                }
+                vEntries.emplace_back();
+                ssKey >> vEntries.back().hash;
+                leveldb::Slice slValue = pcursor->value();
+                vEntries.back().strValue.assign(slValue.data(), slValue.size());
                 pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
             }
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
+
+        boost::thread_group threadGroup;
+        for (size_t i = 1; i < nThreads && i < vEntries.size(); i++)
+            threadGroup.create_thread(boost::bind(&DecodeBlockIndexEntries, boost::ref(vEntries), i, nThreads));
+        DecodeBlockIndexEntries(vEntries, 0, nThreads);
+        threadGroup.join_all();
+
+        for (CBlockIndexLoadEntry& entry : vEntries) {
+            if (!entry.strError.empty())
+                return error("%s : %s", __func__, entry.strError);
+            const CDiskBlockIndex& diskindex = entry.diskindex;
+
+            // Construct block index object
+            CBlockIndex* pindexNew = InsertBlockIndex(entry.hash);
+            pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+
+            //zerocoin
+            pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+            pindexNew->nZerocoinSupply = diskindex.nZerocoinSupply;
+            pindexNew->nMintsInBlock = diskindex.nMintsInBlock;
+
+            //Proof Of Stake
+            pindexNew->nMint = diskindex.nMint;
+            pindexNew->nMoneySupply = diskindex.nMoneySupply;
+            pindexNew->nFlags = diskindex.nFlags;
+            if (!Params().IsStakeModifierV2(pindexNew->nHeight)) {
+                pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            } else {
+                pindexNew->nStakeModifierV2 = diskindex.nStakeModifierV2;
+            }
+            pindexNew->prevoutStake = diskindex.prevoutStake;
+            pindexNew->nStakeTime = diskindex.nStakeTime;
+            pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+
+            //populate accumulator checksum map in memory
+            if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
+                //Don't load any checkpoints that exist before v2 zznn. The accumulator is invalid for v1 and not used.
+                if (pindexNew->nHeight >= Params().Zerocoin_Block_V2_Start())
+                    LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
+
+                nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
+            }
+        }
     }
 
     return true;
@@ -426,3 +568,93 @@ bool CZerocoinDB::EraseAccumulatorValue(const uint32_t& nChecksum)
     LogPrint("zero", "%s : checksum:%d\n", __func__, nChecksum);
     return Erase(std::make_pair('2', nChecksum));
 }
+
+bool CZerocoinDB::WriteChecksumHeight(const uint32_t& nChecksum, libzerocoin::CoinDenomination denom, int nHeight)
+{
+    return Write(std::make_pair('c', std::make_pair(nChecksum, (int)denom)), nHeight);
+}
+
+bool CZerocoinDB::EraseChecksumHeight(const uint32_t& nChecksum, libzerocoin::CoinDenomination denom)
+{
+    return Erase(std::make_pair('c', std::make_pair(nChecksum, (int)denom)));
+}
+
+bool CZerocoinDB::LoadChecksumHeights(std::map<std::pair<uint32_t, libzerocoin::CoinDenomination>, int>& mapHeights)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << std::make_pair('c', std::make_pair((uint32_t)0, 0));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'c')
+                break;
+            std::pair<uint32_t, int> key;
+            ssKey >> key;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            int nHeight;
+            ssValue >> nHeight;
+            mapHeights[std::make_pair(key.first, static_cast<libzerocoin::CoinDenomination>(key.second))] = nHeight;
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CZerocoinDB::WriteBlockMints(int nHeight, const uint256& hashBlock, const std::list<libzerocoin::PublicCoin>& listPubcoins, bool fHasInvalid)
+{
+    std::vector<std::pair<int, CBigNum> > vMints;
+    vMints.reserve(listPubcoins.size());
+    for (const libzerocoin::PublicCoin& pubcoin : listPubcoins)
+        vMints.emplace_back(static_cast<int>(pubcoin.getDenomination()), pubcoin.getValue());
+
+    return Write(std::make_pair('b', nHeight), std::make_pair(hashBlock, std::make_pair(fHasInvalid, vMints)));
+}
+
+bool CZerocoinDB::ReadBlockMints(int nHeight, const uint256& hashBlock, std::list<libzerocoin::PublicCoin>& listPubcoins, bool& fHasInvalid)
+{
+    std::pair<uint256, std::pair<bool, std::vector<std::pair<int, CBigNum> > > > value;
+    if (!Read(std::make_pair('b', nHeight), value))
+        return false;
+
+    // Entry written for a block that has since been reorganized away
+    if (value.first != hashBlock)
+        return false;
+
+    fHasInvalid = value.second.first;
+    libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
+    for (const auto& mint : value.second.second)
+        listPubcoins.emplace_back(params, mint.second, static_cast<libzerocoin::CoinDenomination>(mint.first));
+
+    return true;
+}
+
+bool CZerocoinDB::EraseBlockMints(int nHeight)
+{
+    return Erase(std::make_pair('b', nHeight));
+}
+
+bool CZerocoinDB::WriteFlag(const std::string& name, bool fValue)
+{
+    return Write(std::make_pair('F', name), fValue ? '1' : '0');
+}
+
+bool CZerocoinDB::ReadFlag(const std::string& name, bool& fValue)
+{
+    char ch;
+    if (!Read(std::make_pair('F', name), ch))
+        return false;
+    fValue = ch == '1';
+    return true;
+}
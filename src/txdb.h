@@ -12,6 +12,7 @@
 #include "main.h"
 #include "zznn/zerocoin.h"
 
+#include <list>
 #include <map>
 #include <string>
 #include <utility>
@@ -66,6 +67,16 @@ public:
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
+    /** Pillar collaterals (outpoint, (block height, tx index)) of the active chain up to hashBest */
+    bool UpdatePillarCollaterals(const uint256& hashBest, unsigned int nMaxPillars,
+                                 const std::vector<std::pair<COutPoint, std::pair<int, int> > >& vWrite,
+                                 const std::vector<COutPoint>& vErase);
+    bool LoadPillarCollaterals(uint256& hashBest, unsigned int& nMaxPillars, std::vector<std::pair<COutPoint, std::pair<int, int> > >& vCollaterals);
+    bool WipePillarCollaterals();
+    /** Pillar collaterals spent by a block, to restore them when it is disconnected */
+    bool WritePillarUndo(const uint256& hashBlock, const std::vector<std::pair<COutPoint, std::pair<int, int> > >& vSpent);
+    bool ReadPillarUndo(const uint256& hashBlock, std::vector<std::pair<COutPoint, std::pair<int, int> > >& vSpent);
+    bool ErasePillarUndo(const uint256& hashBlock);
     bool LoadBlockIndexGuts();
 };
 
@@ -94,6 +105,16 @@ public:
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
     bool ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnValue);
     bool EraseAccumulatorValue(const uint32_t& nChecksum);
+    /** First height of the active chain at which an accumulator checksum appears */
+    bool WriteChecksumHeight(const uint32_t& nChecksum, libzerocoin::CoinDenomination denom, int nHeight);
+    bool EraseChecksumHeight(const uint32_t& nChecksum, libzerocoin::CoinDenomination denom);
+    bool LoadChecksumHeights(std::map<std::pair<uint32_t, libzerocoin::CoinDenomination>, int>& mapHeights);
+    /** Zerocoin mints of the block at a height, without invalid outpoints, so accumulators can skip the block files */
+    bool WriteBlockMints(int nHeight, const uint256& hashBlock, const std::list<libzerocoin::PublicCoin>& listPubcoins, bool fHasInvalid);
+    bool ReadBlockMints(int nHeight, const uint256& hashBlock, std::list<libzerocoin::PublicCoin>& listPubcoins, bool& fHasInvalid);
+    bool EraseBlockMints(int nHeight);
+    bool WriteFlag(const std::string& name, bool fValue);
+    bool ReadFlag(const std::string& name, bool& fValue);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -657,6 +657,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (PAIRTYPE(const uint256, CWalletTx) & item : mapWallet)
             item.second.MarkDirty();
+        fStakeCandidatesDirty = true;
     }
 }
 
@@ -711,6 +712,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        MarkStakeCandidatesDirty(wtx);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -763,12 +765,31 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     }
 }
 
+void CWallet::UpdatedBlockTip(const CBlockIndex* pindex)
+{
+    // Keep the accumulator witnesses of our unspent zZNN up to date, so that
+    // spending or staking a mint only has to accumulate the last blocks.
+    // Stakes need witnesses at least a stake depth deep, which also keeps
+    // them clear of most reorganizations. The accumulation itself runs in
+    // ThreadUpdateStoredWitnesses, not on the thread connecting blocks.
+    if (!fFileBacked || !pindex)
+        return;
+
+    int nHeightStop = pindex->nHeight - Params().Zerocoin_RequiredStakeDepth() - 10;
+    nHeightStop -= nHeightStop % 10;
+    if (nHeightStop > Params().Zerocoin_Block_V2_Start())
+        nStoredWitnessHeightStop = nHeightStop;
+}
+
 void CWallet::EraseFromWallet(const uint256& hash)
 {
     if (!fFileBacked)
         return;
     {
         LOCK(cs_wallet);
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+            MarkStakeCandidatesDirty(mi->second);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
     }
@@ -1654,81 +1675,90 @@ void CWallet::AvailableCoins(
             const uint256& wtxid = it->first;
             const CWalletTx* pcoin = &(*it).second;
 
-            if (!CheckFinalTx(*pcoin)) {
-                continue;
-            }
+            AvailableCoinsFromTx(wtxid, pcoin, vCoins, fOnlyConfirmed, coinControl, fIncludeZeroValue, nCoinType, fUseIX, nWatchonlyConfig);
+        }
+    }
+}
 
-            if (fOnlyConfirmed && !pcoin->IsTrusted()) {
-                continue;
-            }
+void CWallet::AvailableCoinsFromTx(const uint256& wtxid, const CWalletTx* pcoin, std::vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl,
+                                   bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX, int nWatchonlyConfig) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
 
-            if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0) {
-                continue;
-            }
+    if (!CheckFinalTx(*pcoin)) {
+        return;
+    }
 
-            int nDepth = pcoin->GetDepthInMainChain(false);
-            // do not use IX for inputs that have less then 6 blockchain confirmations
-            if (fUseIX && nDepth < 6) {
-                continue;
-            }
+    if (fOnlyConfirmed && !pcoin->IsTrusted()) {
+        return;
+    }
 
-            // We should not consider coins which aren't at least in our mempool
-            // It's possible for these to be conflicted via ancestors which we may never be able to detect
-            if (nDepth == 0 && !pcoin->InMempool()) {
-                continue;
-            }
+    if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0) {
+        return;
+    }
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                bool found = false;
-                if (nCoinType == ONLY_DENOMINATED) {
-                    found = IsDenominatedAmount(pcoin->vout[i].nValue);
-                } else if (nCoinType == ONLY_NOT10000IFMN) {
-                    found = !(fMasterNode && (pcoin->vout[i].nValue == MNA * COIN || pcoin->vout[i].nValue == MNP * COIN));
-                } else if (nCoinType == ONLY_NONDENOMINATED_NOT10000IFMN) {
-                    if (IsCollateralAmount(pcoin->vout[i].nValue)) continue; // do not use collateral amounts
-                        found = !IsDenominatedAmount(pcoin->vout[i].nValue);
-                    if (found && fMasterNode) 
-                        found = (pcoin->vout[i].nValue != MNA * COIN || pcoin->vout[i].nValue != MNP * COIN); // do not use Hot MN funds
-                } else if (nCoinType == ONLY_10000) {
-                    found = (pcoin->vout[i].nValue == MNA * COIN || pcoin->vout[i].nValue == MNP * COIN);
-                } else {
-                    found = true;
-                }
-                if (!found) continue;
+    int nDepth = pcoin->GetDepthInMainChain(false);
+    // do not use IX for inputs that have less then 6 blockchain confirmations
+    if (fUseIX && nDepth < 6) {
+        return;
+    }
 
-                if (nCoinType == STAKABLE_COINS) {
-                    if (pcoin->vout[i].IsZerocoinMint())
-                        continue;
-                }
+    // We should not consider coins which aren't at least in our mempool
+    // It's possible for these to be conflicted via ancestors which we may never be able to detect
+    if (nDepth == 0 && !pcoin->InMempool()) {
+        return;
+    }
 
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (IsSpent(wtxid, i))
-                    continue;
-                if (mine == ISMINE_NO)
-                    continue;
+    for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+        bool found = false;
+        if (nCoinType == ONLY_DENOMINATED) {
+            found = IsDenominatedAmount(pcoin->vout[i].nValue);
+        } else if (nCoinType == ONLY_NOT10000IFMN) {
+            found = !(fMasterNode && (pcoin->vout[i].nValue == MNA * COIN || pcoin->vout[i].nValue == MNP * COIN));
+        } else if (nCoinType == ONLY_NONDENOMINATED_NOT10000IFMN) {
+            if (IsCollateralAmount(pcoin->vout[i].nValue)) continue; // do not use collateral amounts
+                found = !IsDenominatedAmount(pcoin->vout[i].nValue);
+            if (found && fMasterNode) 
+                found = (pcoin->vout[i].nValue != MNA * COIN || pcoin->vout[i].nValue != MNP * COIN); // do not use Hot MN funds
+        } else if (nCoinType == ONLY_10000) {
+            found = (pcoin->vout[i].nValue == MNA * COIN || pcoin->vout[i].nValue == MNP * COIN);
+        } else {
+            found = true;
+        }
+        if (!found) continue;
 
-                if ((mine == ISMINE_MULTISIG || mine == ISMINE_SPENDABLE) && nWatchonlyConfig == 2)
-                    continue;
+        if (nCoinType == STAKABLE_COINS) {
+            if (pcoin->vout[i].IsZerocoinMint())
+                continue;
+        }
 
-                if (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1)
-                    continue;
+        isminetype mine = IsMine(pcoin->vout[i]);
+        if (IsSpent(wtxid, i))
+            continue;
+        if (mine == ISMINE_NO)
+            continue;
 
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000)
-                    continue;
-                if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
-                    continue;
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
-                    continue;
+        if ((mine == ISMINE_MULTISIG || mine == ISMINE_SPENDABLE) && nWatchonlyConfig == 2)
+            continue;
 
-                bool fIsSpendable = false;
-                if ((mine & ISMINE_SPENDABLE) != ISMINE_NO)
-                    fIsSpendable = true;
-                if ((mine & ISMINE_MULTISIG) != ISMINE_NO)
-                    fIsSpendable = true;
+        if (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1)
+            continue;
 
-                vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
-            }
-        }
+        if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_10000)
+            continue;
+        if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
+            continue;
+        if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(wtxid, i))
+            continue;
+
+        bool fIsSpendable = false;
+        if ((mine & ISMINE_SPENDABLE) != ISMINE_NO)
+            fIsSpendable = true;
+        if ((mine & ISMINE_MULTISIG) != ISMINE_NO)
+            fIsSpendable = true;
+
+        vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
     }
 }
 
@@ -1813,29 +1843,30 @@ bool CWallet::SelectStakeCoins(std::list<std::unique_ptr<CStakeInput> >& listInp
 {
     LOCK(cs_main);
     //Add ZNN
-    std::vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, NULL, false, STAKABLE_COINS);
     CAmount nAmountSelected = 0;
     if (GetBoolArg("-znnstake", true) && !fPrecompute) {
-        for (const COutput &out : vCoins) {
+        LOCK(cs_wallet);
+        UpdateStakeCandidates();
+        for (auto& it : mapStakeCandidates) {
+            CZnnStake& candidate = it.second;
             //make sure not to outrun target amount
-            if (nAmountSelected + out.tx->vout[out.i].nValue > nTargetAmount)
-                continue;
-
-            if (out.tx->vin[0].IsZerocoinSpend() && !out.tx->IsInMainChain())
+            if (nAmountSelected + candidate.GetValue() > nTargetAmount)
                 continue;
 
-            CBlockIndex* utxoBlock = mapBlockIndex.at(out.tx->hashBlock);
+            CBlockIndex* utxoBlock = candidate.GetIndexFrom();
             //check for maturity (min age/depth)
             if (!Params().HasStakeMinAgeOrDepth(blockHeight, GetAdjustedTime(), utxoBlock->nHeight, utxoBlock->GetBlockTime()))
                 continue;
 
-            //add to our stake set
-            nAmountSelected += out.tx->vout[out.i].nValue;
+            //find the v1 stake modifier once per candidate, the copy below carries it
+            if (!Params().IsStakeModifierV2(blockHeight)) {
+                uint64_t nStakeModifier;
+                candidate.GetModifier(nStakeModifier);
+            }
 
-            std::unique_ptr<CZnnStake> input(new CZnnStake());
-            input->SetInput((CTransaction) *out.tx, out.i);
-            listInputs.emplace_back(std::move(input));
+            //add to our stake set
+            nAmountSelected += candidate.GetValue();
+            listInputs.emplace_back(new CZnnStake(candidate));
         }
     }
 
@@ -1873,6 +1904,77 @@ bool CWallet::SelectStakeCoins(std::list<std::unique_ptr<CStakeInput> >& listInp
     return true;
 }
 
+void CWallet::MarkStakeCandidatesDirty(const CTransaction& tx)
+{
+    AssertLockHeld(cs_wallet);
+
+    //the outputs it creates and the outputs it spends
+    setStakeCandidatesDirtyTx.insert(tx.GetHash());
+    for (const CTxIn& txin : tx.vin)
+        setStakeCandidatesDirtyTx.insert(txin.prevout.hash);
+}
+
+void CWallet::UpdateStakeCandidates()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    CBlockIndex* pindexTip = chainActive.Tip();
+    if (fStakeCandidatesDirty || !pindexStakeCandidatesTip || !chainActive.Contains(pindexStakeCandidatesTip)) {
+        //first pass, reorg or every wallet transaction changed
+        mapStakeCandidates.clear();
+        setStakeCandidatesImmatureTx.clear();
+        setStakeCandidatesDirtyTx.clear();
+        for (const PAIRTYPE(const uint256, CWalletTx) & item : mapWallet)
+            setStakeCandidatesDirtyTx.insert(item.first);
+    } else if (pindexTip != pindexStakeCandidatesTip) {
+        //coinstakes and coinbases only mature as the tip moves
+        setStakeCandidatesDirtyTx.insert(setStakeCandidatesImmatureTx.begin(), setStakeCandidatesImmatureTx.end());
+    }
+
+    if (setStakeCandidatesDirtyTx.empty()) {
+        pindexStakeCandidatesTip = pindexTip;
+        return;
+    }
+
+    std::vector<COutput> vCoins;
+    for (const uint256& hash : setStakeCandidatesDirtyTx) {
+        std::map<COutPoint, CZnnStake>::iterator it = mapStakeCandidates.lower_bound(COutPoint(hash, 0));
+        while (it != mapStakeCandidates.end() && it->first.hash == hash)
+            mapStakeCandidates.erase(it++);
+        setStakeCandidatesImmatureTx.erase(hash);
+
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi == mapWallet.end())
+            continue;
+        const CWalletTx& wtx = mi->second;
+        if ((wtx.IsCoinBase() || wtx.IsCoinStake()) && wtx.GetBlocksToMaturity() > 0) {
+            if (wtx.GetDepthInMainChain(false) > 0)
+                setStakeCandidatesImmatureTx.insert(hash);
+            continue;
+        }
+
+        vCoins.clear();
+        AvailableCoinsFromTx(hash, &wtx, vCoins, true, NULL, false, STAKABLE_COINS, false, 1);
+        for (const COutput& out : vCoins) {
+            if (out.tx->vin[0].IsZerocoinSpend() && !out.tx->IsInMainChain())
+                continue;
+
+            //the wallet knows the block of the output, no need to look the transaction up again
+            BlockMap::iterator bi = mapBlockIndex.find(out.tx->hashBlock);
+            if (bi == mapBlockIndex.end() || !chainActive.Contains(bi->second))
+                continue;
+
+            mapStakeCandidates[COutPoint(hash, out.i)].SetInput((CTransaction) *out.tx, out.i, bi->second);
+        }
+    }
+
+    setStakeCandidatesDirtyTx.clear();
+    pindexStakeCandidatesTip = pindexTip;
+    fStakeCandidatesDirty = false;
+    LogPrint("staking", "%s : %d stake candidates\n", __func__, mapStakeCandidates.size());
+}
+
 bool CWallet::MintableCoins()
 {
     LOCK(cs_main);
@@ -2376,7 +2478,24 @@ bool CWallet::CreateCoinStake(
         nTxNewTime = pindexPrev->nTime;
     }
 
-    for (std::unique_ptr<CStakeInput>& stakeInput : listInputs) {
+    // With more than one stake thread, or with time protocol V2 where the kernels are hashed in batches,
+    // the kernel is searched ahead over all remaining inputs at once, the loop below then only has to
+    // build the coinstake for the input that was found
+    int nStakeThreads = GetArg("-stakethreads", DEFAULT_STAKE_THREADS);
+    if (nStakeThreads <= 0)
+        nStakeThreads = boost::thread::hardware_concurrency();
+    nStakeThreads = std::max(1, std::min(nStakeThreads, MAX_STAKE_THREADS));
+    const bool fSearchAhead = nStakeThreads > 1 || Params().IsTimeProtocolV2(pindexPrev->nHeight + 1);
+
+    std::vector<CStakeInput*> vInputs;
+    for (std::unique_ptr<CStakeInput>& stakeInput : listInputs)
+        vInputs.push_back(stakeInput.get());
+    size_t nSearchedUpTo = 0;
+    int nKernelInput = -1;
+    uint256 hashKernelProofOfStake = 0;
+
+    for (size_t nInput = 0; nInput < vInputs.size(); nInput++) {
+        CStakeInput* stakeInput = vInputs[nInput];
         nCredit = 0;
         // Make sure the wallet is unlocked and shutdown hasn't been requested
         if (IsLocked() || ShutdownRequested())
@@ -2384,8 +2503,21 @@ bool CWallet::CreateCoinStake(
 
         uint256 hashProofOfStake = 0;
         nAttempts++;
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (Stake(pindexPrev, stakeInput.get(), nBits, nTxNewTime, hashProofOfStake)) {
+        bool fStaked;
+        if (fSearchAhead) {
+            if (nInput >= nSearchedUpTo) {
+                nKernelInput = StakeParallel(pindexPrev, vInputs, nInput, nBits, nTxNewTime, hashKernelProofOfStake, nStakeThreads);
+                nSearchedUpTo = nKernelInput < 0 ? vInputs.size() : nKernelInput + 1;
+            }
+            fStaked = (int)nInput == nKernelInput;
+            if (fStaked)
+                hashProofOfStake = hashKernelProofOfStake;
+        } else {
+            //iterates each utxo inside of CheckStakeKernelHash()
+            fStaked = Stake(pindexPrev, stakeInput, nBits, nTxNewTime, hashProofOfStake);
+        }
+
+        if (fStaked) {
 
             // Found a kernel
             LogPrintf("CreateCoinStake : kernel found\n");
@@ -2440,7 +2572,7 @@ bool CWallet::CreateCoinStake(
 
             //Mark mints as spent
             if (stakeInput->IsZZNN()) {
-                CZZnnStake* z = (CZZnnStake*)stakeInput.get();
+                CZZnnStake* z = (CZZnnStake*)stakeInput;
                 if (!z->MarkSpent(this, txNew.GetHash()))
                     return error("%s: failed to mark mint as used\n", __func__);
             }
@@ -2571,6 +2703,8 @@ CAmount CWallet::GetMinimumFee(unsigned int nTxBytes, unsigned int nConfirmTarge
     // prevent user from paying a non-sense fee (like 1 satoshi): 0 < fee < minRelayFee
     if (nFeeNeeded < ::minRelayTxFee.GetFee(nTxBytes))
         nFeeNeeded = ::minRelayTxFee.GetFee(nTxBytes);
+    // ... or one our own full mempool would not take
+    nFeeNeeded = std::max(nFeeNeeded, pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nTxBytes));
     // But always obey the maximum
     if (nFeeNeeded > maxTxFee)
         nFeeNeeded = maxTxFee;
@@ -3016,17 +3150,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    setStakeCandidatesDirtyTx.insert(output.hash);
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    setStakeCandidatesDirtyTx.insert(output.hash);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
+    for (const COutPoint& output : setLockedCoins)
+        setStakeCandidatesDirtyTx.insert(output.hash);
     setLockedCoins.clear();
 }
 
@@ -3935,7 +4073,15 @@ bool CWallet::MintsToInputVector(std::map<CBigNum, CZerocoinMint>& mapMintsSelec
             CMintMeta meta = zznnTracker->Get(GetSerialHash(mint.GetSerialNumber()));
             CoinWitnessData *coinWitness = zznnTracker->GetSpendCache(meta.hashStake);
 
-            if (!coinWitness->nHeightAccEnd) {
+            // Start from the witness kept up to date as blocks connect, when it is
+            // further along than the cached one but not past the height needed here
+            CoinWitnessData *storedWitness = zznnTracker->GetStoredWitness(meta.hashStake);
+            if (storedWitness->nHeightAccEnd > coinWitness->nHeightAccEnd &&
+                    storedWitness->nHeightAccEnd < GetWitnessHeightStop(pindexCheckpoint)) {
+                CoinWitnessCacheData data(storedWitness);
+                *coinWitness = CoinWitnessData(data);
+                coinWitness->hashAccEnd = storedWitness->hashAccEnd;
+            } else if (!coinWitness->nHeightAccEnd) {
                 *coinWitness = CoinWitnessData(mint);
                 coinWitness->SetHeightMintAdded(mint.GetHeight());
             }
@@ -4786,6 +4932,93 @@ bool CWallet::DatabaseMint(CDeterministicMint& dMint)
     return true;
 }
 
+void ThreadUpdateStoredWitnesses()
+{
+    boost::this_thread::interruption_point();
+    LogPrintf("ThreadUpdateStoredWitnesses started\n");
+    CWallet* pwallet = pwalletMain;
+    try {
+        pwallet->UpdateStoredWitnesses();
+        boost::this_thread::interruption_point();
+    } catch (std::exception& e) {
+        LogPrintf("ThreadUpdateStoredWitnesses() exception: %s \n", e.what());
+    } catch (...) {
+        LogPrintf("ThreadUpdateStoredWitnesses() error \n");
+    }
+    LogPrintf("ThreadUpdateStoredWitnesses exiting,\n");
+}
+
+void CWallet::UpdateStoredWitnesses()
+{
+    RenameThread("Zenon-witnesses");
+
+    // Blocks accumulated per lock of cs_main, so block validation never waits
+    // long on a mint that is far behind
+    static const int nWitnessUpdateStep = 100;
+
+    int nHeightDone = 0;
+    while (!ShutdownRequested()) {
+        MilliSleep(1000);
+
+        int nHeightStop = nStoredWitnessHeightStop;
+        if (nHeightStop <= nHeightDone || IsLocked())
+            continue;
+
+        {
+            TRY_LOCK(zznnTracker->cs_spendcache, fLocked);
+            if (!fLocked)
+                continue; // a spend or stake is using the witnesses, try again later
+            zznnTracker->PruneStoredWitnesses();
+        }
+
+        bool fComplete = true;
+        for (const CMintMeta& meta : zznnTracker->GetMints(true)) {
+            if (meta.isArchived || meta.nHeight >= nHeightStop)
+                continue;
+
+            while (fComplete) {
+                boost::this_thread::interruption_point();
+                if (ShutdownRequested() || IsLocked()) {
+                    fComplete = false;
+                    break;
+                }
+
+                LOCK(cs_main);
+                TRY_LOCK(zznnTracker->cs_spendcache, fLocked);
+                if (!fLocked) {
+                    fComplete = false;
+                    break;
+                }
+
+                CoinWitnessData* witness = zznnTracker->GetStoredWitness(meta.hashStake);
+                if (witness->nHeightAccEnd >= nHeightStop - 1)
+                    break;
+
+                if (!witness->coin) {
+                    CZerocoinMint mint;
+                    if (!GetMint(meta.hashSerial, mint))
+                        break;
+                    *witness = CoinWitnessData(mint);
+                }
+
+                int nHeightAccEndPrev = witness->nHeightAccEnd;
+                int nHeightStep = std::max(witness->nHeightAccStart, witness->nHeightAccEnd) + nWitnessUpdateStep;
+                nHeightStep = std::min(nHeightStep - nHeightStep % 10, nHeightStop);
+                if (!AdvanceAccumulatorWitness(witness, nHeightStep)) {
+                    zznnTracker->EraseStoredWitness(meta.hashStake);
+                    break;
+                }
+                zznnTracker->WriteStoredWitness(meta.hashStake);
+                if (witness->nHeightAccEnd <= nHeightAccEndPrev)
+                    break; // nothing left to accumulate below the stop height
+            }
+        }
+
+        if (fComplete)
+            nHeightDone = nHeightStop;
+    }
+}
+
 void ThreadPrecomputeSpends()
 {
     boost::this_thread::interruption_point();
@@ -4901,6 +5134,14 @@ void CWallet::PrecomputeSpends()
                 setInputHashes.insert(serialHash);
                 CoinWitnessData* witnessData = zznnTracker->GetSpendCache(serialHash);
 
+                // Start from the witness kept up to date as blocks connect, when it is further along
+                CoinWitnessData* storedWitness = zznnTracker->GetStoredWitness(serialHash);
+                if (storedWitness->nHeightAccEnd > witnessData->nHeightAccEnd) {
+                    CoinWitnessCacheData data(storedWitness);
+                    *witnessData = CoinWitnessData(data);
+                    witnessData->hashAccEnd = storedWitness->hashAccEnd;
+                }
+
                 // Initialize nHeightStop so it can be set below
                 int nHeightStop = 0;
 
@@ -29,6 +29,7 @@
 #include "zznn/zznntracker.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -61,6 +62,10 @@ static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWa
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 //! -custombackupthreshold default
 static const int DEFAULT_CUSTOMBACKUPTHRESHOLD = 1;
+//! -stakethreads default, a single thread searches the stake kernel
+static const int DEFAULT_STAKE_THREADS = 1;
+//! Maximum number of stake kernel search threads
+static const int MAX_STAKE_THREADS = 16;
 //! -enableautoconvertaddress default
 static const bool DEFAULT_AUTOCONVERTADDRESS = false;
 
@@ -196,6 +201,23 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /** Add the available outputs of one wallet transaction, see AvailableCoins */
+    void AvailableCoinsFromTx(const uint256& wtxid, const CWalletTx* pcoin, std::vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl,
+                              bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX, int nWatchonlyConfig) const;
+
+    /**
+     * Stakable outputs with their origin block, kept between staking passes. Only the
+     * transactions marked since the last pass are looked at again, plus coinstakes and
+     * coinbases still maturing when the tip moved. Rebuilt after a reorg or MarkDirty.
+     */
+    std::map<COutPoint, CZnnStake> mapStakeCandidates;
+    std::set<uint256> setStakeCandidatesDirtyTx;
+    std::set<uint256> setStakeCandidatesImmatureTx;
+    CBlockIndex* pindexStakeCandidatesTip;
+    bool fStakeCandidatesDirty;
+    void MarkStakeCandidatesDirty(const CTransaction& tx);
+    void UpdateStakeCandidates();
+
 public:
 
     static const int STAKE_SPLIT_THRESHOLD = 2000;
@@ -345,6 +367,9 @@ public:
 
         nStakeSplitThreshold = STAKE_SPLIT_THRESHOLD;
         nStakeSetUpdateTime = 300; // 5 minutes
+        pindexStakeCandidatesTip = NULL;
+        nStoredWitnessHeightStop = 0;
+        fStakeCandidatesDirty = true;
 
         //MultiSend
         vMultiSend.clear();
@@ -416,6 +441,10 @@ public:
 
     void PrecomputeSpends();
 
+    //! height the stored zZNN witnesses should be advanced to, set as blocks connect
+    std::atomic<int> nStoredWitnessHeightStop;
+    void UpdateStoredWitnesses();
+
     //! check whether we are allowed to upgrade (or already support) to the named feature
     bool CanSupportFeature(enum WalletFeature wf)
     {
@@ -504,6 +533,7 @@ public:
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    void UpdatedBlockTip(const CBlockIndex* pindex);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
@@ -1247,5 +1277,6 @@ private:
 };
 
 void ThreadPrecomputeSpends();
+void ThreadUpdateStoredWitnesses();
 
 #endif // BITCOIN_WALLET_H
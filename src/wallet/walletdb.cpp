@@ -1481,6 +1481,26 @@ bool CWalletDB::ErasePrecompute(const uint256& hash)
     return Erase(std::make_pair(std::string("precompute"), hash));
 }
 
+bool CWalletDB::WriteWitness(const uint256& hashStake, const CoinWitnessCacheData& data, const uint256& hashAccEnd)
+{
+    return Write(std::make_pair(std::string("zwitness"), hashStake), std::make_pair(data, hashAccEnd));
+}
+
+bool CWalletDB::ReadWitness(const uint256& hashStake, CoinWitnessCacheData& data, uint256& hashAccEnd)
+{
+    std::pair<CoinWitnessCacheData, uint256> witness;
+    if (!Read(std::make_pair(std::string("zwitness"), hashStake), witness))
+        return false;
+    data = witness.first;
+    hashAccEnd = witness.second;
+    return true;
+}
+
+bool CWalletDB::EraseWitness(const uint256& hashStake)
+{
+    return Erase(std::make_pair(std::string("zwitness"), hashStake));
+}
+
 //! map with hashMasterSeed as the key, paired with vector of hashPubcoins and their count
 std::map<uint256, std::vector<std::pair<uint256, uint32_t> > > CWalletDB::MapMintPool()
 {
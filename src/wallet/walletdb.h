@@ -198,6 +198,10 @@ public:
     bool ReadPrecompute(const uint256& hash, CoinWitnessCacheData& data);
     bool ErasePrecompute(const uint256& hash);
 
+    bool WriteWitness(const uint256& hashStake, const CoinWitnessCacheData& data, const uint256& hashAccEnd);
+    bool ReadWitness(const uint256& hashStake, CoinWitnessCacheData& data, uint256& hashAccEnd);
+    bool EraseWitness(const uint256& hashStake);
+
 private:
     CWalletDB(const CWalletDB&);
     void operator=(const CWalletDB&);
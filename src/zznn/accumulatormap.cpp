@@ -9,6 +9,9 @@
 #include "txdb.h"
 #include "libzerocoin/Denominations.h"
 
+#include "checkqueue.h"
+#include "util.h"
+
 
 //Construct accumulators for all denominations
 AccumulatorMap::AccumulatorMap(libzerocoin::ZerocoinParams* params)
@@ -72,6 +75,62 @@ bool AccumulatorMap::Accumulate(const libzerocoin::PublicCoin& pubCoin, bool fSk
     return true;
 }
 
+// Each denomination is one check, so hand them out to the workers one at a time
+static CCheckQueue<CAccumulatorCheck> accumulatorcheckqueue(1);
+
+void ThreadAccumulatorCheck()
+{
+    RenameThread("Zenon-accumch");
+    accumulatorcheckqueue.Thread();
+}
+
+bool CAccumulatorCheck::operator()()
+{
+    // a worker must not throw, an exception fails the whole checkpoint instead
+    try {
+        for (const libzerocoin::PublicCoin* pubCoin : vCoins) {
+            if (fSkipValidation)
+                accumulator->increment(pubCoin->getValue());
+            else
+                accumulator->accumulate(*pubCoin);
+        }
+    } catch (const std::exception& e) {
+        return error("CAccumulatorCheck(): failed to accumulate denomination %d: %s", libzerocoin::ZerocoinDenominationToInt(accumulator->getDenomination()), e.what());
+    } catch (...) {
+        return error("CAccumulatorCheck(): failed to accumulate denomination %d", libzerocoin::ZerocoinDenominationToInt(accumulator->getDenomination()));
+    }
+    return true;
+}
+
+//Add a list of zerocoins. The accumulators of different denominations do not depend on each other,
+//so each denomination is accumulated as its own check on the accumulator check queue.
+bool AccumulatorMap::Accumulate(const std::list<libzerocoin::PublicCoin>& listPubcoins, bool fSkipValidation)
+{
+    std::map<libzerocoin::CoinDenomination, std::vector<const libzerocoin::PublicCoin*> > mapDenomCoins;
+    for (const libzerocoin::PublicCoin& pubCoin : listPubcoins) {
+        if (pubCoin.getDenomination() == libzerocoin::CoinDenomination::ZQ_ERROR)
+            return false;
+        mapDenomCoins[pubCoin.getDenomination()].push_back(&pubCoin);
+    }
+
+    std::vector<CAccumulatorCheck> vChecks;
+    for (const auto& denomCoins : mapDenomCoins)
+        vChecks.emplace_back(mapAccumulators.at(denomCoins.first).get(), denomCoins.second, fSkipValidation);
+
+    if (!nScriptCheckThreads) {
+        for (CAccumulatorCheck& check : vChecks) {
+            if (!check())
+                return false;
+        }
+        return true;
+    }
+
+    // the calling thread works through the queue as well
+    CCheckQueueControl<CAccumulatorCheck> control(&accumulatorcheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
 libzerocoin::Accumulator AccumulatorMap::GetAccumulator(libzerocoin::CoinDenomination denom)
 {
     return libzerocoin::Accumulator(params, denom, GetValue(denom));
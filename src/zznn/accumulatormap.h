@@ -10,6 +10,35 @@
 #include "libzerocoin/Coin.h"
 #include "accumulatorcheckpoints.h"
 
+#include <list>
+#include <vector>
+
+/** Closure adding the coins of one denomination to its accumulator, run on the accumulator check queue */
+class CAccumulatorCheck
+{
+private:
+    libzerocoin::Accumulator* accumulator;
+    std::vector<const libzerocoin::PublicCoin*> vCoins;
+    bool fSkipValidation;
+
+public:
+    CAccumulatorCheck() : accumulator(NULL), fSkipValidation(false) {}
+    CAccumulatorCheck(libzerocoin::Accumulator* accumulatorIn, const std::vector<const libzerocoin::PublicCoin*>& vCoinsIn, bool fSkipValidationIn) :
+        accumulator(accumulatorIn), vCoins(vCoinsIn), fSkipValidation(fSkipValidationIn) {}
+
+    bool operator()();
+
+    void swap(CAccumulatorCheck& check)
+    {
+        std::swap(accumulator, check.accumulator);
+        vCoins.swap(check.vCoins);
+        std::swap(fSkipValidation, check.fSkipValidation);
+    }
+};
+
+/** Run accumulator check queue worker threads, started next to the script check threads */
+void ThreadAccumulatorCheck();
+
 //A map with an accumulator for each denomination
 class AccumulatorMap
 {
@@ -21,6 +50,7 @@ public:
     bool Load(uint256 nCheckpoint);
     void Load(const AccumulatorCheckpoints::Checkpoint& checkpoint);
     bool Accumulate(const libzerocoin::PublicCoin& pubCoin, bool fSkipValidation = false);
+    bool Accumulate(const std::list<libzerocoin::PublicCoin>& listPubcoins, bool fSkipValidation = false);
     libzerocoin::Accumulator GetAccumulator(libzerocoin::CoinDenomination denom);
     CBigNum GetValue(libzerocoin::CoinDenomination denom);
     uint256 GetCheckpoint();
@@ -18,6 +18,11 @@
 std::map<uint32_t, CBigNum> mapAccumulatorValues;
 std::list<uint256> listAccCheckpointsNoDB;
 
+//! First height of every (checksum, denomination) in the active chain, mirrors the zerocoinDB index
+std::map<std::pair<uint32_t, libzerocoin::CoinDenomination>, int> mapChecksumHeights;
+bool fChecksumHeightsLoaded = false;
+CCriticalSection cs_checksumheights;
+
 
 uint32_t ParseChecksum(uint256 nChecksum, libzerocoin::CoinDenomination denomination)
 {
@@ -38,9 +43,93 @@ uint32_t GetChecksum(const CBigNum &bnValue)
 }
 
 
+// Checkpoints only change every 10 blocks, these are the heights that can introduce a checksum
+static bool IsChecksumHeight(int nHeight)
+{
+    int nStartHeight = Params().Zerocoin_StartHeight();
+    if (nHeight < nStartHeight)
+        return false;
+    return nHeight % 10 == 0 || nHeight < nStartHeight + (10 - nStartHeight % 10) % 10;
+}
+
+
+void AddChecksumHeights(const CBlockIndex* pindex)
+{
+    if (!IsChecksumHeight(pindex->nHeight))
+        return;
+
+    LOCK(cs_checksumheights);
+    for (auto& denom : libzerocoin::zerocoinDenomList) {
+        uint32_t nChecksum = ParseChecksum(pindex->nAccumulatorCheckpoint, denom);
+        auto key = std::make_pair(nChecksum, denom);
+        if (mapChecksumHeights.count(key))
+            continue;
+        mapChecksumHeights.insert(std::make_pair(key, pindex->nHeight));
+        zerocoinDB->WriteChecksumHeight(nChecksum, denom, pindex->nHeight);
+    }
+}
+
+
+void EraseChecksumHeights(const CBlockIndex* pindex)
+{
+    if (!IsChecksumHeight(pindex->nHeight))
+        return;
+
+    LOCK(cs_checksumheights);
+    for (auto& denom : libzerocoin::zerocoinDenomList) {
+        uint32_t nChecksum = ParseChecksum(pindex->nAccumulatorCheckpoint, denom);
+        auto it = mapChecksumHeights.find(std::make_pair(nChecksum, denom));
+        //only the block that introduced the checksum removes it
+        if (it == mapChecksumHeights.end() || it->second != pindex->nHeight)
+            continue;
+        mapChecksumHeights.erase(it);
+        zerocoinDB->EraseChecksumHeight(nChecksum, denom);
+    }
+}
+
+
+bool LoadChecksumHeights()
+{
+    LOCK(cs_checksumheights);
+    mapChecksumHeights.clear();
+    fChecksumHeightsLoaded = false;
+
+    bool fIndexed = false;
+    if (zerocoinDB->ReadFlag("checksumheights", fIndexed) && fIndexed) {
+        if (!zerocoinDB->LoadChecksumHeights(mapChecksumHeights))
+            return false;
+    } else {
+        //first start with the index, build it from the active chain
+        LogPrintf("%s : indexing accumulator checksum heights\n", __func__);
+        for (CBlockIndex* pindex = chainActive[Params().Zerocoin_StartHeight()]; pindex; pindex = chainActive.Next(pindex))
+            AddChecksumHeights(pindex);
+        if (!zerocoinDB->WriteFlag("checksumheights", true))
+            return false;
+    }
+
+    LogPrintf("%s : loaded %u accumulator checksum heights\n", __func__, mapChecksumHeights.size());
+    fChecksumHeightsLoaded = true;
+    return true;
+}
+
+
 // Find the first occurance of a certain accumulator checksum. Return 0 if not found.
 int GetChecksumHeight(uint32_t nChecksum, libzerocoin::CoinDenomination denomination)
 {
+    {
+        LOCK(cs_checksumheights);
+        if (fChecksumHeightsLoaded) {
+            auto it = mapChecksumHeights.find(std::make_pair(nChecksum, denomination));
+            if (it == mapChecksumHeights.end())
+                return 0;
+
+            CBlockIndex* pindex = chainActive[it->second];
+            if (pindex && ParseChecksum(pindex->nAccumulatorCheckpoint, denomination) == nChecksum)
+                return pindex->nHeight;
+            //the block is not (yet) in the active chain, look it up the slow way
+        }
+    }
+
     CBlockIndex* pindex = chainActive[Params().Zerocoin_StartHeight()];
     if (!pindex)
         return 0;
@@ -265,7 +354,7 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
     bool fFilterInvalid = nHeight >= Params().Zerocoin_Block_RecalculateAccumulators();
 
     //Accumulate all coins over the last ten blocks that havent been accumulated (height - 20 through height - 11)
-    int nTotalMintsFound = 0;
+    std::list<libzerocoin::PublicCoin> listPubcoinsRange;
     CBlockIndex *pindex = chainActive[nHeightCheckpoint - 20];
 
     while (pindex->nHeight < nHeight - 10) {
@@ -280,27 +369,21 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
         }
 
         //grab mints from this block
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex))
-            return error("%s: failed to read block from disk", __func__);
-
         std::list<libzerocoin::PublicCoin> listPubcoins;
-        if (!BlockToPubcoinList(block, listPubcoins, fFilterInvalid))
+        if (!BlockToPubcoinList(pindex, listPubcoins, fFilterInvalid))
             return error("%s: failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
 
-        nTotalMintsFound += listPubcoins.size();
         LogPrint("zero", "%s found %d mints\n", __func__, listPubcoins.size());
-
-        //add the pubcoins to accumulator
-        for (const libzerocoin::PublicCoin& pubcoin : listPubcoins) {
-            if(!mapAccumulators.Accumulate(pubcoin, true))
-                return error("%s: failed to add pubcoin to accumulator at height %d", __func__, pindex->nHeight);
-        }
+        listPubcoinsRange.splice(listPubcoinsRange.end(), listPubcoins);
         pindex = chainActive.Next(pindex);
     }
 
+    //add the pubcoins to the accumulators, one check queue job per denomination
+    if (!mapAccumulators.Accumulate(listPubcoinsRange, true))
+        return error("%s: failed to add pubcoins to accumulators at height %d", __func__, nHeight);
+
     // if there were no new mints found, the accumulator checkpoint will be the same as the last checkpoint
-    if (nTotalMintsFound == 0)
+    if (listPubcoinsRange.empty())
         nCheckpoint = chainActive[nHeight - 1]->nAccumulatorCheckpoint;
     else
         nCheckpoint = mapAccumulators.GetCheckpoint();
@@ -351,7 +434,7 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
     CBlockIndex* pindex = chainActive[GetZerocoinStartHeight()];
     int n = 0;
     while (pindex->nHeight < nHeightEnd) {
-        n += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
+        n += pindex->GetMintsInBlock(denom);
         pindex = chainActive.Next(pindex);
     }
 
@@ -361,11 +444,8 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
 
 std::list<libzerocoin::PublicCoin> GetPubcoinFromBlock(const CBlockIndex* pindex){
     //grab mints from this block
-    CBlock block;
-    if(!ReadBlockFromDisk(block, pindex))
-        throw GetPubcoinException("GetPubcoinFromBlock: failed to read block from disk while adding pubcoins to witness");
     std::list<libzerocoin::PublicCoin> listPubcoins;
-    if(!BlockToPubcoinList(block, listPubcoins, true))
+    if(!BlockToPubcoinList(pindex, listPubcoins, true))
         throw GetPubcoinException("GetPubcoinFromBlock: failed to get zerocoin mintlist from block "+std::to_string(pindex->nHeight)+"\n");
     return listPubcoins;
 }
@@ -513,6 +593,7 @@ void AccumulateRange(CoinWitnessData* coinWitness, int nHeightEnd)
     while (pindex && pindex->nHeight <= nHeightEnd) {
         coinWitness->nMintsAdded += AddBlockMintsToAccumulator(coinWitness, pindex, true);
         coinWitness->nHeightAccEnd = pindex->nHeight;
+        coinWitness->hashAccEnd = pindex->GetBlockHash();
 
         // 10 blocks were accumulated twice when zZNN v2 was activated
         if (pindex->nHeight == Params().Zerocoin_Block_Double_Accumulated() + 10 && !fDoubleCounted) {
@@ -528,15 +609,33 @@ void AccumulateRange(CoinWitnessData* coinWitness, int nHeightEnd)
 }
 
 
-bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& mapAccumulators, CBlockIndex* pindexCheckpoint)
+int GetWitnessHeightStop(const CBlockIndex* pindexCheckpoint)
 {
-    try {
-        // Lock
-        LogPrint("zero", "%s: generating\n", __func__);
-        if (!LockMethod()) return false;
-        LogPrint("zero", "%s: after lock\n", __func__);
+    if (pindexCheckpoint) {
+        int nHeightStop = pindexCheckpoint->nHeight - 10;
+        return nHeightStop - nHeightStop % 10;
+    }
 
-        int64_t nTimeStart = GetTimeMicros();
+    //add the pubcoins from the blockchain up to the next checksum starting from the block
+    int nChainHeight = chainActive.Height();
+    return nChainHeight - nChainHeight % 10 - 20; // at least two checkpoints deep
+}
+
+
+bool AdvanceAccumulatorWitness(CoinWitnessData* coinWitness, int nHeightStop)
+{
+    // walks chainActive and reads the blocks of the range
+    LOCK(cs_main);
+    try {
+        //Coins cannot be taken out of an accumulator, start over if the accumulated blocks were reorganized away
+        if (coinWitness->nHeightAccEnd && !coinWitness->hashAccEnd.IsNull()) {
+            CBlockIndex* pindexAccEnd = chainActive[coinWitness->nHeightAccEnd];
+            if (!pindexAccEnd || pindexAccEnd->GetBlockHash() != coinWitness->hashAccEnd) {
+                LogPrint("zero", "%s: witness accumulated to a block that is no longer in the chain\n", __func__);
+                coinWitness->nHeightAccEnd = 0;
+                coinWitness->nMintsAdded = 0;
+            }
+        }
 
         //If there is a Acc End height filled in, then this has already been partially accumulated.
         if (!coinWitness->nHeightAccEnd) {
@@ -555,23 +654,37 @@ bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& ma
             coinWitness->pAccumulator->setValue(witnessAccumulator.getValue());
         }
 
-        //add the pubcoins from the blockchain up to the next checksum starting from the block
-        int nChainHeight = chainActive.Height();
-        int nHeightMax = nChainHeight % 10;
-        nHeightMax = nChainHeight - nHeightMax - 20; // at least two checkpoints deep
+        if (nHeightStop > coinWitness->nHeightAccEnd)
+            AccumulateRange(coinWitness, nHeightStop - 1);
+
+        return true;
+    } catch (searchMintHeightException e) {
+        return error("%s: searchMintHeightException: %s", __func__, e.message);
+    } catch (ChecksumInDbNotFoundException e) {
+        return error("%s: ChecksumInDbNotFoundException: %s", __func__, e.message);
+    } catch (GetPubcoinException e) {
+        return error("%s: GetPubcoinException: %s", __func__, e.message);
+    }
+}
+
+
+bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& mapAccumulators, CBlockIndex* pindexCheckpoint)
+{
+    try {
+        // Lock
+        LogPrint("zero", "%s: generating\n", __func__);
+        if (!LockMethod()) return false;
+        LogPrint("zero", "%s: after lock\n", __func__);
+
+        int64_t nTimeStart = GetTimeMicros();
 
         // Determine the height to stop at
-        int nHeightStop;
-        if (pindexCheckpoint) {
-            nHeightStop = pindexCheckpoint->nHeight - 10;
-            nHeightStop -= nHeightStop % 10;
+        int nHeightStop = GetWitnessHeightStop(pindexCheckpoint);
+        if (pindexCheckpoint)
             LogPrint("zero", "%s: using checkpoint height %d\n", __func__, pindexCheckpoint->nHeight);
-        } else {
-            nHeightStop = nHeightMax;
-        }
 
-        if (nHeightStop > coinWitness->nHeightAccEnd)
-            AccumulateRange(coinWitness, nHeightStop - 1);
+        if (!AdvanceAccumulatorWitness(coinWitness, nHeightStop))
+            return false;
 
         mapAccumulators.Load(chainActive[nHeightStop + 10]->nAccumulatorCheckpoint);
         coinWitness->pWitness->resetValue(*coinWitness->pAccumulator, *coinWitness->coin);
@@ -905,8 +1018,7 @@ std::map<libzerocoin::CoinDenomination, int> GetMintMaturityHeight()
         for (auto denom : libzerocoin::zerocoinDenomList) {
             //If the denom has not already had a mint added to it, then see if it has a mint added on this block
             if (mapDenomMaturity.at(denom).first < Params().Zerocoin_RequiredAccumulation()) {
-                mapDenomMaturity.at(denom).first += count(pindex->vMintDenominationsInBlock.begin(),
-                                                          pindex->vMintDenominationsInBlock.end(), denom);
+                mapDenomMaturity.at(denom).first += pindex->GetMintsInBlock(denom);
 
                 //if mint was found then record this block as the first block that maturity occurs.
                 if (mapDenomMaturity.at(denom).first >= Params().Zerocoin_RequiredAccumulation())
@@ -49,6 +49,10 @@ bool GenerateAccumulatorWitness(
 
 
 bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& mapAccumulators, CBlockIndex* pindexCheckpoint);
+/** Height up to which GenerateAccumulatorWitness accumulates a witness for the given (or no) checkpoint */
+int GetWitnessHeightStop(const CBlockIndex* pindexCheckpoint);
+/** Accumulate the mints of the blocks below nHeightStop into the witness, without verifying it */
+bool AdvanceAccumulatorWitness(CoinWitnessData* coinWitness, int nHeightStop);
 std::list<libzerocoin::PublicCoin> GetPubcoinFromBlock(const CBlockIndex* pindex);
 bool GetAccumulatorValueFromDB(uint256 nCheckpoint, libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
 bool GetAccumulatorValue(int& nHeight, const libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
@@ -61,6 +65,9 @@ bool EraseAccumulatorValues(const uint256& nCheckpointErase, const uint256& nChe
 uint32_t ParseChecksum(uint256 nChecksum, libzerocoin::CoinDenomination denomination);
 uint32_t GetChecksum(const CBigNum &bnValue);
 int GetChecksumHeight(uint32_t nChecksum, libzerocoin::CoinDenomination denomination);
+void AddChecksumHeights(const CBlockIndex* pindex);
+void EraseChecksumHeights(const CBlockIndex* pindex);
+bool LoadChecksumHeights();
 bool InvalidCheckpointRange(int nHeight);
 bool ValidateAccumulatorCheckpoint(const CBlock& block, CBlockIndex* pindex, AccumulatorMap& mapAccumulators);
 
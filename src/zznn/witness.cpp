@@ -16,6 +16,7 @@ void CoinWitnessData::SetNull()
     nHeightCheckpoint = 0;
     nHeightAccStart = 0;
     nHeightAccEnd = 0;
+    hashAccEnd = 0;
 }
 
 CoinWitnessData::CoinWitnessData()
@@ -31,6 +31,7 @@ public:
     int nMintsAdded;
     uint256 txid;
     bool isV1;
+    uint256 hashAccEnd; // block at nHeightAccEnd, to notice reorganizations
 
     CoinWitnessData();
     CoinWitnessData(CZerocoinMint& mint);
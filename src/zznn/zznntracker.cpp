@@ -134,6 +134,65 @@ bool CzZNNTracker::ClearSpendCache()
     return false;
 }
 
+CoinWitnessData* CzZNNTracker::GetStoredWitness(const uint256& hashStake)
+{
+    AssertLockHeld(cs_spendcache);
+    auto it = mapWitnessStore.find(hashStake);
+    if (it != mapWitnessStore.end())
+        return it->second.get();
+
+    //first use since startup, pick up what was stored in the wallet
+    std::unique_ptr<CoinWitnessData> uptr(new CoinWitnessData());
+    CoinWitnessCacheData data;
+    uint256 hashAccEnd;
+    if (CWalletDB(strWalletFile).ReadWitness(hashStake, data, hashAccEnd)) {
+        uptr.reset(new CoinWitnessData(data));
+        uptr->hashAccEnd = hashAccEnd;
+    }
+
+    CoinWitnessData* witness = uptr.get();
+    mapWitnessStore.insert(std::make_pair(hashStake, std::move(uptr)));
+    return witness;
+}
+
+bool CzZNNTracker::WriteStoredWitness(const uint256& hashStake)
+{
+    AssertLockHeld(cs_spendcache);
+    auto it = mapWitnessStore.find(hashStake);
+    if (it == mapWitnessStore.end() || !it->second->pAccumulator)
+        return false;
+
+    CoinWitnessCacheData data(it->second.get());
+    return CWalletDB(strWalletFile).WriteWitness(hashStake, data, it->second->hashAccEnd);
+}
+
+void CzZNNTracker::EraseStoredWitness(const uint256& hashStake)
+{
+    AssertLockHeld(cs_spendcache);
+    mapWitnessStore.erase(hashStake);
+    CWalletDB(strWalletFile).EraseWitness(hashStake);
+}
+
+//Forget the witnesses of mints that were spent or archived
+void CzZNNTracker::PruneStoredWitnesses()
+{
+    AssertLockHeld(cs_spendcache);
+    std::set<uint256> setUnspent;
+    for (auto& it : mapSerialHashes) {
+        if (!it.second.isUsed && !it.second.isArchived)
+            setUnspent.insert(it.second.hashStake);
+    }
+
+    for (auto it = mapWitnessStore.begin(); it != mapWitnessStore.end();) {
+        if (setUnspent.count(it->first)) {
+            ++it;
+            continue;
+        }
+        CWalletDB(strWalletFile).EraseWitness(it->first);
+        it = mapWitnessStore.erase(it);
+    }
+}
+
 std::vector<uint256> CzZNNTracker::GetSerialHashes()
 {
     std::vector<uint256> vHashes;
@@ -81,6 +81,45 @@ bool BlockToPubcoinList(const CBlock& block, std::list<libzerocoin::PublicCoin>&
     return true;
 }
 
+//Same as above, served from the zerocoinDB block mint index when possible instead of reading the block from disk
+bool BlockToPubcoinList(const CBlockIndex* pindex, std::list<libzerocoin::PublicCoin>& listPubcoins, bool fFilterInvalid)
+{
+    std::list<libzerocoin::PublicCoin> listIndexed;
+    bool fHasInvalid = false;
+    bool fIndexed = zerocoinDB->ReadBlockMints(pindex->nHeight, pindex->GetBlockHash(), listIndexed, fHasInvalid);
+
+    // The index holds the filtered list, only unfiltered reads of blocks with invalid mints need the block
+    if (fIndexed && (fFilterInvalid || !fHasInvalid)) {
+        listPubcoins.splice(listPubcoins.end(), listIndexed);
+        return true;
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        return error("%s: failed to read block %d from disk", __func__, pindex->nHeight);
+
+    //fill in the index for blocks that were connected before it existed
+    if (!fIndexed && chainActive.Contains(pindex))
+        IndexBlockMints(block, pindex);
+
+    return BlockToPubcoinList(block, listPubcoins, fFilterInvalid);
+}
+
+//Record the valid mints of a block in the zerocoinDB, see BlockToPubcoinList(const CBlockIndex*, ...)
+bool IndexBlockMints(const CBlock& block, const CBlockIndex* pindex)
+{
+    std::list<libzerocoin::PublicCoin> listPubcoins;
+    if (!BlockToPubcoinList(block, listPubcoins, true))
+        return error("%s: failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
+
+    std::list<libzerocoin::PublicCoin> listAll;
+    if (!BlockToPubcoinList(block, listAll, false))
+        return error("%s: failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
+
+    bool fHasInvalid = listAll.size() != listPubcoins.size();
+    return zerocoinDB->WriteBlockMints(pindex->nHeight, pindex->GetBlockHash(), listPubcoins, fHasInvalid);
+}
+
 //return a list of zerocoin mints contained in a specific block
 bool BlockToZerocoinMintList(const CBlock& block, std::list<CZerocoinMint>& vMints, bool fFilterInvalid)
 {
@@ -277,6 +316,9 @@ std::string ReindexZerocoinDB()
             return _("Reindexing zerocoin failed");
         }
 
+        if (!IndexBlockMints(block, pindex))
+            return _("Error writing zerocoinDB to disk");
+
         for (const CTransaction& tx : block.vtx) {
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 if (tx.IsCoinBase())